@@ -0,0 +1,94 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Vidulum developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test building -addressindex and -spentindex for an existing datadir.
+#
+# Node 0 runs without the indexes, node 1 has them from genesis. Node 0 is
+# then restarted with the indexes turned on, builds them in the background,
+# and must answer getaddresstxids and getspentinfo the same as node 1.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, initialize_chain_clean, \
+    start_node, stop_node, connect_nodes_bi
+
+import time
+
+
+class IndexBuildTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-addressindex", "-spentindex"]))
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.sync_all()
+
+    def wait_for_index_build(self, node, address):
+        # The build runs in the background after startup, the address
+        # index answers once it is turned on
+        for _ in range(120):
+            if "indexbuild" not in node.getblockchaininfo():
+                try:
+                    node.getaddresstxids({"addresses": [address]})
+                    return
+                except JSONRPCException:
+                    pass
+            time.sleep(0.5)
+        raise AssertionError("index build did not finish")
+
+    def get_spent_info(self, node, txid, n):
+        try:
+            return node.getspentinfo({"txid": txid, "index": n})
+        except JSONRPCException:
+            return None
+
+    def run_test(self):
+        self.nodes[0].generate(101)
+        self.sync_all()
+
+        # Pay a few addresses, then spend those outputs again
+        addresses = [self.nodes[0].getnewaddress() for _ in range(3)]
+        txids = [self.nodes[0].sendtoaddress(address, 1) for address in addresses]
+        self.nodes[0].generate(1)
+        txids.append(self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 2.5))
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        # Every address and output those transactions touch
+        outputs = []
+        for txid in txids:
+            tx = self.nodes[0].decoderawtransaction(self.nodes[0].gettransaction(txid)["hex"])
+            for vout in tx["vout"]:
+                outputs.append((txid, vout["n"]))
+                addresses.extend(vout["scriptPubKey"].get("addresses", []))
+            for vin in tx["vin"]:
+                outputs.append((vin["txid"], vin["vout"]))
+        addresses = sorted(set(addresses))
+
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-addressindex", "-spentindex"])
+        self.wait_for_index_build(self.nodes[0], addresses[0])
+
+        for address in addresses:
+            query = {"addresses": [address]}
+            assert_equal(self.nodes[0].getaddresstxids(query), self.nodes[1].getaddresstxids(query))
+        spent = 0
+        for txid, n in outputs:
+            info = self.get_spent_info(self.nodes[1], txid, n)
+            assert_equal(self.get_spent_info(self.nodes[0], txid, n), info)
+            if info is not None:
+                spent += 1
+        assert(spent > 0)
+
+if __name__ == '__main__':
+    IndexBuildTest().main()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Vidulum developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the mempool is saved on shutdown and loaded again on restart,
+# unless -persistmempool=0 is given.
+#
+# Node 0 pays its own addresses, so nodes 1 and 2 only hold the
+# transactions in their mempools and cannot get them back from a wallet.
+# Some of them form a parent-child chain, which is only reloaded in full
+# if parents are added before their children.
+# They are restarted without connections, so nothing is relayed to them.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, find_output, start_node, stop_node
+
+from decimal import Decimal
+import time
+
+
+class MempoolPersistTest(BitcoinTestFramework):
+
+    def wait_for_mempool_size(self, node, size):
+        # The mempool is loaded in the background after startup
+        for _ in range(60):
+            if len(node.getrawmempool()) == size:
+                break
+            time.sleep(0.5)
+        assert_equal(len(node.getrawmempool()), size)
+
+    def run_test(self):
+        txids = []
+        for _ in range(5):
+            txids.append(self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1))
+
+        # A chain of three, each spending the output of the one before
+        amount = Decimal("10")
+        parent = self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), amount)
+        txids.append(parent)
+        for _ in range(2):
+            inputs = [{"txid": parent, "vout": find_output(self.nodes[0], parent, amount)}]
+            amount -= Decimal("0.0001")
+            rawtx = self.nodes[0].createrawtransaction(inputs, {self.nodes[0].getnewaddress(): amount})
+            signed = self.nodes[0].signrawtransaction(rawtx)
+            parent = self.nodes[0].sendrawtransaction(signed["hex"])
+            txids.append(parent)
+        self.sync_all()
+        assert_equal(len(self.nodes[1].getrawmempool()), 8)
+        assert_equal(len(self.nodes[2].getrawmempool()), 8)
+
+        stop_node(self.nodes[1], 1)
+        stop_node(self.nodes[2], 2)
+        self.nodes[1] = start_node(1, self.options.tmpdir)
+        self.nodes[2] = start_node(2, self.options.tmpdir, ["-persistmempool=0"])
+
+        self.wait_for_mempool_size(self.nodes[1], 8)
+        assert_equal(set(self.nodes[1].getrawmempool()), set(txids))
+        # The chain is back with its dependencies
+        entries = self.nodes[1].getrawmempool(True)
+        assert_equal(entries[txids[6]]["depends"], [txids[5]])
+        assert_equal(entries[txids[7]]["depends"], [txids[6]])
+        time.sleep(1)
+        assert_equal(len(self.nodes[2].getrawmempool()), 0)
+
+if __name__ == '__main__':
+    MempoolPersistTest().main()
@@ -0,0 +1,140 @@
+// Copyright (c) 2018 The Vidulum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+
+#include "consensus/consensus.h"
+#include "core_memusage.h"
+#include "crypto/common.h"
+#include "main.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileMap blockfilemap;
+CBlockCache blockcache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)data, size);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMap::Map(int nFile, uint64_t nEnd)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    // Mapping every block file needs more address space than 32-bit systems have
+    if (sizeof(void*) < 8)
+        return nullptr;
+
+    LOCK(cs);
+    std::map<int, std::shared_ptr<const CMappedBlockFile> >::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end() && it->second->size >= nEnd)
+        return it->second;
+
+    // Readers still holding an older, shorter map keep it until they are done
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size >= nEnd)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<const CMappedBlockFile> file = std::make_shared<CMappedBlockFile>((const char*)data, (size_t)st.st_size);
+    mapFiles[nFile] = file;
+    return file;
+#endif
+}
+
+bool CBlockFileMap::Find(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart, CMappedBlock& block)
+{
+    const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < nHeaderSize)
+        return false;
+    std::shared_ptr<const CMappedBlockFile> file = Map(pos.nFile, pos.nPos);
+    if (!file)
+        return false;
+
+    // Only the recorded extent of the block is ever read, which stays inside
+    // the file when FlushBlockFile truncates its preallocated tail
+    const char* pheader = file->data + pos.nPos - nHeaderSize;
+    if (memcmp(pheader, messageStart, MESSAGE_START_SIZE))
+        return false;
+    unsigned int nSize = ReadLE32((const unsigned char*)pheader + MESSAGE_START_SIZE);
+    if (nSize > MAX_BLOCK_SIZE_AFTER_UPGRADE)
+        return false;
+    if (pos.nPos + (uint64_t)nSize > file->size) {
+        file = Map(pos.nFile, pos.nPos + (uint64_t)nSize);
+        if (!file)
+            return false;
+    }
+
+    block.file = file;
+    block.pbegin = file->data + pos.nPos;
+    block.pend = block.pbegin + nSize;
+    return true;
+}
+
+void CBlockFileMap::Unmap(int nFile)
+{
+    LOCK(cs);
+    mapFiles.erase(nFile);
+}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    map_type::iterator it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return nullptr;
+    listBlocks.splice(listBlocks.begin(), listBlocks, it->second.first);
+    return it->second.first->second;
+}
+
+void CBlockCache::Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    size_t nBlockUsage = sizeof(CBlock) + RecursiveDynamicUsage(*pblock);
+    LOCK(cs);
+    if (nBlockUsage > nMaxUsage || mapBlocks.count(hash))
+        return;
+    listBlocks.push_front(std::make_pair(hash, pblock));
+    mapBlocks.insert(std::make_pair(hash, std::make_pair(listBlocks.begin(), nBlockUsage)));
+    nUsage += nBlockUsage;
+    Trim();
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+size_t CBlockCache::DynamicUsage() const
+{
+    LOCK(cs);
+    return nUsage;
+}
+
+void CBlockCache::Trim()
+{
+    while (nUsage > nMaxUsage) {
+        map_type::iterator it = mapBlocks.find(listBlocks.back().first);
+        nUsage -= it->second.second;
+        mapBlocks.erase(it);
+        listBlocks.pop_back();
+    }
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Vidulum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTORE_H
+#define BITCOIN_BLOCKSTORE_H
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "protocol.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+
+#include <boost/unordered_map.hpp>
+
+//! -blockcache default (MiB)
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+
+/** A read-only memory map of one block file */
+class CMappedBlockFile
+{
+private:
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    const char* data;
+    size_t size;
+
+    CMappedBlockFile(const char* dataIn, size_t sizeIn) : data(dataIn), size(sizeIn) {}
+    ~CMappedBlockFile();
+};
+
+/** The stored bytes of one block; holds on to the mapping they are in */
+struct CMappedBlock
+{
+    std::shared_ptr<const CMappedBlockFile> file;
+    const char* pbegin;
+    const char* pend;
+};
+
+/**
+ * Memory maps of the blk?????.dat files, so that reading a block is a
+ * memcpy from the page cache instead of an open, seek and several reads.
+ * Files are mapped on first use and mapped again once they have grown past
+ * a requested block. Not available on Windows or 32-bit systems, where
+ * Find() always fails and callers read the file.
+ */
+class CBlockFileMap
+{
+private:
+    CCriticalSection cs;
+    std::map<int, std::shared_ptr<const CMappedBlockFile> > mapFiles;
+
+    std::shared_ptr<const CMappedBlockFile> Map(int nFile, uint64_t nEnd);
+
+public:
+    /** Find the block stored at pos, checking the message start and size that precede it */
+    bool Find(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart, CMappedBlock& block);
+    //! Forget the map of a file that is about to be deleted
+    void Unmap(int nFile);
+};
+
+/**
+ * Recently read blocks, shared between readers and evicted in least recently
+ * used order once their memory usage exceeds the limit (-blockcache).
+ */
+class CBlockCache
+{
+private:
+    struct HashHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    typedef std::list<std::pair<uint256, std::shared_ptr<const CBlock> > > list_type;
+    //! Position in listBlocks and the memory usage charged for each block
+    typedef boost::unordered_map<uint256, std::pair<list_type::iterator, size_t>, HashHasher> map_type;
+
+    mutable CCriticalSection cs;
+    list_type listBlocks;
+    map_type mapBlocks;
+    size_t nUsage;
+    size_t nMaxUsage;
+
+    void Trim();
+
+public:
+    CBlockCache(size_t nMaxUsageIn) : nUsage(0), nMaxUsage(nMaxUsageIn) {}
+
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+    void Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock);
+    void SetMaxUsage(size_t nMaxUsageIn);
+    size_t DynamicUsage() const;
+};
+
+extern CBlockFileMap blockfilemap;
+extern CBlockCache blockcache;
+
+#endif // BITCOIN_BLOCKSTORE_H
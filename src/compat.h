@@ -46,6 +46,15 @@
 #include <unistd.h>
 #endif
 
+// On Linux the socket handler waits on an epoll instance instead of select(),
+// so connection counts are no longer bounded by FD_SETSIZE.
+#if defined(HAVE_SYS_EPOLL_H) && !defined(WIN32)
+#define USE_EPOLL
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT        0
 #else
@@ -94,7 +103,7 @@ size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_EPOLL)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -0,0 +1,247 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 using the Intel SHA extensions. Based on the public domain
+// implementation by Intel, as adapted by Jeffrey Walton. It is only built
+// with -msse4 -msha and only called after runtime detection (see
+// SHA256AutoDetect in sha256.cpp).
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace {
+
+alignas(__m128i) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Byte shuffle converting each 32-bit lane between big and little endian. */
+alignas(__m128i) const uint8_t MASK[16] = {0x03, 0x02, 0x01, 0x00, 0x07, 0x06, 0x05, 0x04, 0x0b, 0x0a, 0x09, 0x08, 0x0f, 0x0e, 0x0d, 0x0c};
+/** The initial state in the ABEF/CDGH working layout. */
+alignas(__m128i) const uint32_t INIT0[4] = {0x9b05688c, 0x510e527f, 0xbb67ae85, 0x6a09e667};
+alignas(__m128i) const uint32_t INIT1[4] = {0x5be0cd19, 0x1f83d9ab, 0xa54ff53a, 0x3c6ef372};
+
+/** Four rounds, given four message words in m and the round constant offset k. */
+void inline __attribute__((always_inline)) QuadRound(__m128i& state0, __m128i& state1, __m128i m, int k)
+{
+    const __m128i msg = _mm_add_epi32(m, _mm_load_si128((const __m128i*)(K + k)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+void inline __attribute__((always_inline)) ShiftMessageA(__m128i& m0, __m128i m1)
+{
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+}
+
+void inline __attribute__((always_inline)) ShiftMessageC(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+
+void inline __attribute__((always_inline)) ShiftMessageB(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/**
+ * Rounds 4*i to 4*i+3, plus the part of the message schedule that depends on
+ * the words just used. i must be a compile-time constant after inlining.
+ */
+void inline __attribute__((always_inline)) Step(int i, __m128i& state0, __m128i& state1, __m128i* m)
+{
+    QuadRound(state0, state1, m[i & 3], 4 * i);
+    if (i >= 3 && i <= 12) {
+        ShiftMessageB(m[(i + 3) & 3], m[i & 3], m[(i + 1) & 3]);
+    } else if (i >= 13 && i <= 14) {
+        ShiftMessageC(m[(i + 3) & 3], m[i & 3], m[(i + 1) & 3]);
+    } else if (i >= 1 && i <= 2) {
+        ShiftMessageA(m[(i + 3) & 3], m[i & 3]);
+    }
+}
+
+/** Convert the natural state layout to the ABEF/CDGH working layout. */
+void inline __attribute__((always_inline)) Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** Convert the ABEF/CDGH working layout back to the natural state layout. */
+void inline __attribute__((always_inline)) Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+__m128i inline __attribute__((always_inline)) Load(const unsigned char* in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), _mm_load_si128((const __m128i*)MASK));
+}
+
+void inline __attribute__((always_inline)) Save(unsigned char* out, __m128i s)
+{
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, _mm_load_si128((const __m128i*)MASK)));
+}
+
+/** All 64 rounds of one block, with the message words already in m. */
+void inline __attribute__((always_inline)) Rounds(__m128i& s0, __m128i& s1, __m128i* m)
+{
+    Step(0, s0, s1, m);
+    Step(1, s0, s1, m);
+    Step(2, s0, s1, m);
+    Step(3, s0, s1, m);
+    Step(4, s0, s1, m);
+    Step(5, s0, s1, m);
+    Step(6, s0, s1, m);
+    Step(7, s0, s1, m);
+    Step(8, s0, s1, m);
+    Step(9, s0, s1, m);
+    Step(10, s0, s1, m);
+    Step(11, s0, s1, m);
+    Step(12, s0, s1, m);
+    Step(13, s0, s1, m);
+    Step(14, s0, s1, m);
+    Step(15, s0, s1, m);
+}
+
+/** All 64 rounds of two independent blocks, interleaved so both dependency chains are in flight. */
+void inline __attribute__((always_inline)) Rounds2(__m128i& as0, __m128i& as1, __m128i* am, __m128i& bs0, __m128i& bs1, __m128i* bm)
+{
+    Step(0, as0, as1, am); Step(0, bs0, bs1, bm);
+    Step(1, as0, as1, am); Step(1, bs0, bs1, bm);
+    Step(2, as0, as1, am); Step(2, bs0, bs1, bm);
+    Step(3, as0, as1, am); Step(3, bs0, bs1, bm);
+    Step(4, as0, as1, am); Step(4, bs0, bs1, bm);
+    Step(5, as0, as1, am); Step(5, bs0, bs1, bm);
+    Step(6, as0, as1, am); Step(6, bs0, bs1, bm);
+    Step(7, as0, as1, am); Step(7, bs0, bs1, bm);
+    Step(8, as0, as1, am); Step(8, bs0, bs1, bm);
+    Step(9, as0, as1, am); Step(9, bs0, bs1, bm);
+    Step(10, as0, as1, am); Step(10, bs0, bs1, bm);
+    Step(11, as0, as1, am); Step(11, bs0, bs1, bm);
+    Step(12, as0, as1, am); Step(12, bs0, bs1, bm);
+    Step(13, as0, as1, am); Step(13, bs0, bs1, bm);
+    Step(14, as0, as1, am); Step(14, bs0, bs1, bm);
+    Step(15, as0, as1, am); Step(15, bs0, bs1, bm);
+}
+
+/** Message words of the padding block that follows a 64-byte input. */
+void inline __attribute__((always_inline)) PaddingBlock(__m128i* m)
+{
+    m[0] = _mm_set_epi32(0, 0, 0, 0x80000000);
+    m[1] = _mm_setzero_si128();
+    m[2] = _mm_setzero_si128();
+    m[3] = _mm_set_epi32(0x200, 0, 0, 0);
+}
+
+/** Message words of a 32-byte digest (in natural layout) padded as a complete message. */
+void inline __attribute__((always_inline)) DigestBlock(__m128i* m, __m128i s0, __m128i s1)
+{
+    m[0] = s0;
+    m[1] = s1;
+    m[2] = _mm_set_epi32(0, 0, 0, 0x80000000);
+    m[3] = _mm_set_epi32(0x100, 0, 0, 0);
+}
+
+}
+
+namespace sha256_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--) {
+        __m128i m[4] = {Load(chunk), Load(chunk + 16), Load(chunk + 32), Load(chunk + 48)};
+        const __m128i so0 = s0, so1 = s1;
+        Rounds(s0, s1, m);
+        s0 = _mm_add_epi32(s0, so0);
+        s1 = _mm_add_epi32(s1, so1);
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+}
+
+namespace sha256d64_shani {
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    const __m128i init0 = _mm_load_si128((const __m128i*)INIT0);
+    const __m128i init1 = _mm_load_si128((const __m128i*)INIT1);
+    __m128i am[4], bm[4];
+    __m128i as0 = init0, as1 = init1, bs0 = init0, bs1 = init1;
+
+    // First hash, first block: the two inputs.
+    for (int i = 0; i < 4; i++) {
+        am[i] = Load(in + 16 * i);
+        bm[i] = Load(in + 64 + 16 * i);
+    }
+    Rounds2(as0, as1, am, bs0, bs1, bm);
+    as0 = _mm_add_epi32(as0, init0);
+    as1 = _mm_add_epi32(as1, init1);
+    bs0 = _mm_add_epi32(bs0, init0);
+    bs1 = _mm_add_epi32(bs1, init1);
+
+    // First hash, second block: padding for a 512-bit message.
+    {
+        const __m128i aso0 = as0, aso1 = as1, bso0 = bs0, bso1 = bs1;
+        PaddingBlock(am);
+        PaddingBlock(bm);
+        Rounds2(as0, as1, am, bs0, bs1, bm);
+        as0 = _mm_add_epi32(as0, aso0);
+        as1 = _mm_add_epi32(as1, aso1);
+        bs0 = _mm_add_epi32(bs0, bso0);
+        bs1 = _mm_add_epi32(bs1, bso1);
+    }
+
+    // Second hash: the two digests, padded for a 256-bit message.
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    DigestBlock(am, as0, as1);
+    DigestBlock(bm, bs0, bs1);
+    as0 = init0;
+    as1 = init1;
+    bs0 = init0;
+    bs1 = init1;
+    Rounds2(as0, as1, am, bs0, bs1, bm);
+    as0 = _mm_add_epi32(as0, init0);
+    as1 = _mm_add_epi32(as1, init1);
+    bs0 = _mm_add_epi32(bs0, init0);
+    bs1 = _mm_add_epi32(bs1, init1);
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+
+    Save(out, as0);
+    Save(out + 16, as1);
+    Save(out + 32, bs0);
+    Save(out + 48, bs1);
+}
+}
+
+#endif
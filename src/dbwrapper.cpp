@@ -4,9 +4,12 @@
 
 #include "dbwrapper.h"
 
+#include "sync.h"
 #include "util.h"
+#include "utilstrencodings.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -14,14 +17,202 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+#include <algorithm>
+#include <atomic>
+#include <queue>
+#include <set>
+#include <sstream>
+
+/** LRU block cache that counts lookups, for getdbstats. */
+class CDBBlockCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* pcache;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CDBBlockCache(size_t nCapacity) : pcache(leveldb::NewLRUCache(nCapacity)), nHits(0), nMisses(0) {}
+    ~CDBBlockCache() { delete pcache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value))
+    {
+        return pcache->Insert(key, value, charge, deleter);
+    }
+
+    Handle* Lookup(const leveldb::Slice& key)
+    {
+        Handle* handle = pcache->Lookup(key);
+        if (handle)
+            nHits++;
+        else
+            nMisses++;
+        return handle;
+    }
+
+    void Release(Handle* handle) { pcache->Release(handle); }
+    void* Value(Handle* handle) { return pcache->Value(handle); }
+    void Erase(const leveldb::Slice& key) { pcache->Erase(key); }
+    uint64_t NewId() { return pcache->NewId(); }
+};
+
+/** Databases that accept -dbprofile options. */
+static const char* const DB_PROFILE_NAMES[] = {"chainstate", "blockindex", "sporks", "mnpayments"};
+
+/** Named databases currently open, for getdbstats. */
+static CCriticalSection cs_openDBs;
+static std::set<const CDBWrapper*> setOpenDBs;
+
+CDBProfile::CDBProfile(const std::string& strNameIn, size_t nCacheSize) :
+    strName(strNameIn),
+    nBlockCacheSize(nCacheSize / 2),
+    nWriteBufferSize(nCacheSize / 4), // up to two write buffers may be held in memory simultaneously
+    nBlockSize(DEFAULT_DB_BLOCK_SIZE),
+    nBloomBits(DEFAULT_DB_BLOOM_BITS),
+    nMaxOpenFiles(DEFAULT_DB_MAX_OPEN_FILES),
+    fCompression(false),
+    nL0Slowdown(DEFAULT_DB_L0_SLOWDOWN),
+    nL0Stop(DEFAULT_DB_L0_STOP),
+    nSubcompactions(DEFAULT_DB_SUBCOMPACTIONS)
+{
+}
+
+void CDBProfile::SetBulkWrites()
+{
+    // Let level-0 grow well past the compaction trigger before writers are
+    // held back, and spread each compaction over several cores so it
+    // catches up before the stop trigger is reached.
+    nL0Slowdown = 20;
+    nL0Stop = 36;
+    nSubcompactions = std::max(std::min(GetNumCores(), 4), 1);
+}
+
+/** Split a -dbprofile option of the form <name>:<setting>=<value>. */
+static bool ParseDBProfileArg(const std::string& strArg, std::string& strName, std::string& strSetting, int64_t& nValue)
+{
+    size_t nColon = strArg.find(':');
+    if (nColon == std::string::npos || nColon == 0)
+        return false;
+    size_t nEquals = strArg.find('=', nColon);
+    if (nEquals == std::string::npos || nEquals == nColon + 1)
+        return false;
+    strName = strArg.substr(0, nColon);
+    strSetting = strArg.substr(nColon + 1, nEquals - nColon - 1);
+    return ParseInt64(strArg.substr(nEquals + 1), &nValue) && nValue >= 0;
+}
+
+void ApplyDBProfileArgs(CDBProfile& profile)
+{
+    if (profile.strName.empty() || !mapMultiArgs.count("-dbprofile"))
+        return;
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-dbprofile"]) {
+        std::string strName, strSetting;
+        int64_t nValue;
+        if (!ParseDBProfileArg(strArg, strName, strSetting, nValue) || strName != profile.strName)
+            continue;
+        if (strSetting == "blockcache")
+            profile.nBlockCacheSize = nValue << 20;
+        else if (strSetting == "writebuffer")
+            profile.nWriteBufferSize = nValue << 20;
+        else if (strSetting == "blocksize")
+            profile.nBlockSize = nValue;
+        else if (strSetting == "bloombits")
+            profile.nBloomBits = nValue;
+        else if (strSetting == "maxopenfiles")
+            profile.nMaxOpenFiles = nValue;
+        else if (strSetting == "compression")
+            profile.fCompression = nValue != 0;
+        else if (strSetting == "l0slowdown")
+            profile.nL0Slowdown = nValue;
+        else if (strSetting == "l0stop")
+            profile.nL0Stop = nValue;
+        else if (strSetting == "subcompactions")
+            profile.nSubcompactions = nValue;
+    }
+}
+
+bool CheckDBProfileArgs(std::string& strError)
+{
+    if (!mapMultiArgs.count("-dbprofile"))
+        return true;
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-dbprofile"]) {
+        std::string strName, strSetting;
+        int64_t nValue;
+        if (!ParseDBProfileArg(strArg, strName, strSetting, nValue)) {
+            strError = strprintf("Invalid -dbprofile option '%s', expected <name>:<setting>=<value>", strArg);
+            return false;
+        }
+        if (std::find(std::begin(DB_PROFILE_NAMES), std::end(DB_PROFILE_NAMES), strName) == std::end(DB_PROFILE_NAMES)) {
+            strError = strprintf("Unknown database '%s' in -dbprofile", strName);
+            return false;
+        }
+        if (strSetting != "blockcache" && strSetting != "writebuffer" && strSetting != "blocksize" &&
+            strSetting != "bloombits" && strSetting != "maxopenfiles" && strSetting != "compression" &&
+            strSetting != "l0slowdown" && strSetting != "l0stop" && strSetting != "subcompactions") {
+            strError = strprintf("Unknown setting '%s' in -dbprofile", strSetting);
+            return false;
+        }
+        if ((strSetting == "blockcache" || strSetting == "writebuffer") && nValue > (1 << 20)) {
+            strError = strprintf("-dbprofile %s is given in MiB and cannot exceed %d", strSetting, 1 << 20);
+            return false;
+        }
+        if ((strSetting == "bloombits" || strSetting == "maxopenfiles") && nValue > 50000) {
+            strError = strprintf("-dbprofile %s cannot exceed %d", strSetting, 50000);
+            return false;
+        }
+        if ((strSetting == "l0slowdown" || strSetting == "l0stop") && (nValue < 1 || nValue > 1000)) {
+            strError = strprintf("-dbprofile %s must be between 1 and %d", strSetting, 1000);
+            return false;
+        }
+        if (strSetting == "subcompactions" && (nValue < 1 || nValue > 64)) {
+            strError = strprintf("-dbprofile %s must be between 1 and %d", strSetting, 64);
+            return false;
+        }
+    }
+    // LevelDB would quietly raise l0stop to l0slowdown. chainstate and
+    // blockindex are also opened with SetBulkWrites, check those too.
+    BOOST_FOREACH(const char* pszName, DB_PROFILE_NAMES) {
+        for (int nBulk = 0; nBulk < 2; nBulk++) {
+            CDBProfile profile(pszName, 0);
+            if (nBulk) {
+                if (profile.strName != "chainstate" && profile.strName != "blockindex")
+                    continue;
+                profile.SetBulkWrites();
+            }
+            ApplyDBProfileArgs(profile);
+            if (profile.nL0Slowdown > profile.nL0Stop) {
+                strError = strprintf("-dbprofile %s:l0slowdown=%d cannot exceed %s:l0stop=%d", pszName, profile.nL0Slowdown, pszName, profile.nL0Stop);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int GetDBProfileExtraFiles()
+{
+    int nExtra = 0;
+    BOOST_FOREACH(const char* pszName, DB_PROFILE_NAMES) {
+        CDBProfile profile(pszName, 0);
+        ApplyDBProfileArgs(profile);
+        nExtra += std::max(profile.nMaxOpenFiles - DEFAULT_DB_MAX_OPEN_FILES, 0);
+    }
+    return nExtra;
+}
+
+static leveldb::Options GetOptions(const CDBProfile& profile, CDBBlockCache* pblockcache)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = pblockcache;
+    options.write_buffer_size = profile.nWriteBufferSize;
+    options.block_size = profile.nBlockSize;
+    options.filter_policy = profile.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = profile.nMaxOpenFiles;
+    options.l0_slowdown_writes_trigger = profile.nL0Slowdown;
+    options.l0_stop_writes_trigger = profile.nL0Stop;
+    options.max_subcompactions = profile.nSubcompactions;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -30,14 +221,22 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(path, CDBProfile("", nCacheSize), fMemory, fWipe)
+{
+}
+
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, const CDBProfile& profileIn, bool fMemory, bool fWipe) :
+    profile(profileIn)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    ApplyDBProfileArgs(profile);
+    pblockcache = new CDBBlockCache(profile.nBlockCacheSize);
+    options = GetOptions(profile, pblockcache);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -54,16 +253,30 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    if (!profile.strName.empty()) {
+        LogPrintf("LevelDB profile %s: block cache %u, write buffer %u, block size %u, bloom bits %d, max open files %d, compression %d, "
+            "level-0 slowdown/stop %d/%d, subcompactions %d\n",
+            profile.strName, profile.nBlockCacheSize, profile.nWriteBufferSize, profile.nBlockSize,
+            profile.nBloomBits, profile.nMaxOpenFiles, profile.fCompression,
+            profile.nL0Slowdown, profile.nL0Stop, profile.nSubcompactions);
+        LOCK(cs_openDBs);
+        setOpenDBs.insert(this);
+    }
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(cs_openDBs);
+        setOpenDBs.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
     options.filter_policy = NULL;
     delete options.block_cache;
     options.block_cache = NULL;
+    pblockcache = NULL;
     delete penv;
     options.env = NULL;
 }
@@ -82,6 +295,413 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+/** Parse a LevelDB property made of space-separated integers. */
+static std::vector<int64_t> GetIntegerProperty(leveldb::DB* pdb, const std::string& strProperty, size_t nCount)
+{
+    std::vector<int64_t> vValues(nCount, 0);
+    std::string strValue;
+    if (pdb->GetProperty(strProperty, &strValue)) {
+        std::istringstream stream(strValue);
+        for (size_t i = 0; i < nCount && (stream >> vValues[i]); i++) {}
+    }
+    return vValues;
+}
+
+CDBStats CDBWrapper::GetStats() const
+{
+    CDBStats stats;
+    stats.strName = profile.strName;
+    for (int nLevel = 0; ; nLevel++) {
+        std::string strValue;
+        if (!pdb->GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), &strValue))
+            break;
+        stats.vFilesPerLevel.push_back(atoi(strValue));
+    }
+    stats.nCacheHits = pblockcache->nHits;
+    stats.nCacheMisses = pblockcache->nMisses;
+    std::vector<int64_t> vStalls = GetIntegerProperty(pdb, "leveldb.write-stalls", 4);
+    stats.nWriteSlowdowns = vStalls[0];
+    stats.nMemtableWaits = vStalls[1];
+    stats.nLevel0Waits = vStalls[2];
+    stats.nStallMicros = vStalls[3];
+    std::vector<int64_t> vCompactions = GetIntegerProperty(pdb, "leveldb.compaction-totals", 3);
+    stats.nCompactionMicros = vCompactions[0];
+    stats.nCompactionBytesRead = vCompactions[1];
+    stats.nCompactionBytesWritten = vCompactions[2];
+    return stats;
+}
+
+std::vector<CDBStats> GetDBStats()
+{
+    std::vector<CDBStats> vStats;
+    LOCK(cs_openDBs);
+    BOOST_FOREACH(const CDBWrapper* pdbwrapper, setOpenDBs)
+        vStats.push_back(pdbwrapper->GetStats());
+    std::sort(vStats.begin(), vStats.end(), [](const CDBStats& a, const CDBStats& b) { return a.strName < b.strName; });
+    return vStats;
+}
+
+/** Merges the sorted runs of a CDBBulkLoader, yielding the newest operation on every key. */
+class CDBRunMerger
+{
+private:
+    struct Run
+    {
+        CAutoFile file;
+        uint64_t nLeft;
+        int nRun;
+        CDBBulkLoader::Entry entry;
+
+        Run(FILE* fileIn, int nRunIn) : file(fileIn, SER_DISK, CLIENT_VERSION), nLeft(0), nRun(nRunIn) {}
+    };
+
+    //! Orders the queue so that its top is the smallest key, from the newest run
+    struct RunOrder
+    {
+        bool operator()(const Run* a, const Run* b) const
+        {
+            int nCompare = a->entry.strKey.compare(b->entry.strKey);
+            return nCompare != 0 ? nCompare > 0 : a->nRun < b->nRun;
+        }
+    };
+
+    std::vector<Run*> vRuns;
+    std::priority_queue<Run*, std::vector<Run*>, RunOrder> queue;
+    CDBBulkLoader::Entry current;
+    bool fValid;
+    std::string strError;
+
+    void Advance(Run* run)
+    {
+        if (run->nLeft == 0)
+            return;
+        run->file >> run->entry;
+        run->nLeft--;
+        queue.push(run);
+    }
+
+public:
+    CDBRunMerger() : fValid(false) {}
+
+    ~CDBRunMerger()
+    {
+        BOOST_FOREACH(Run* run, vRuns)
+            delete run;
+    }
+
+    bool Open(const std::vector<boost::filesystem::path>& vPaths)
+    {
+        try {
+            for (size_t i = 0; i < vPaths.size(); i++) {
+                FILE* file = fopen(vPaths[i].string().c_str(), "rb");
+                if (!file)
+                    return error("%s: cannot open %s", __func__, vPaths[i].string());
+                Run* run = new Run(file, i);
+                vRuns.push_back(run);
+                run->file >> run->nLeft;
+                Advance(run);
+            }
+        } catch (const std::exception& e) {
+            return error("%s: %s", __func__, e.what());
+        }
+        Next();
+        return strError.empty();
+    }
+
+    bool Valid() const { return fValid; }
+    const CDBBulkLoader::Entry& Get() const { return current; }
+    const std::string& GetError() const { return strError; }
+
+    void Next()
+    {
+        fValid = false;
+        if (queue.empty())
+            return;
+        try {
+            Run* run = queue.top();
+            queue.pop();
+            std::swap(current, run->entry);
+            Advance(run);
+            // Operations on the same key in older runs are overridden
+            while (!queue.empty() && queue.top()->entry.strKey == current.strKey) {
+                run = queue.top();
+                queue.pop();
+                Advance(run);
+            }
+            fValid = true;
+        } catch (const std::exception& e) {
+            strError = e.what();
+        }
+    }
+};
+
+/**
+ * Presents the merged entries whose keys start with one byte to LevelDB's
+ * BulkLoad, skipping erased keys. It only moves forward from wherever the
+ * merger is, so SeekToFirst() leaves the position alone.
+ */
+class CDBBulkLoadIterator : public leveldb::Iterator
+{
+private:
+    CDBRunMerger& merger;
+    char chPrefix;
+
+    void SkipErased()
+    {
+        while (Valid() && merger.Get().fErase)
+            merger.Next();
+    }
+
+public:
+    CDBBulkLoadIterator(CDBRunMerger& mergerIn, char chPrefixIn) : merger(mergerIn), chPrefix(chPrefixIn) {}
+
+    bool Valid() const { return merger.Valid() && merger.Get().strKey[0] == chPrefix; }
+    void SeekToFirst() { SkipErased(); }
+    void SeekToLast() { assert(false); }
+    void Seek(const leveldb::Slice& target) { assert(false); }
+    void Next() { merger.Next(); SkipErased(); }
+    void Prev() { assert(false); }
+    leveldb::Slice key() const { return merger.Get().strKey; }
+    leveldb::Slice value() const { return merger.Get().strValue; }
+
+    leveldb::Status status() const
+    {
+        if (!merger.GetError().empty())
+            return leveldb::Status::IOError("bulk load run", merger.GetError());
+        return leveldb::Status::OK();
+    }
+};
+
+CDBBulkLoader::CDBBulkLoader(const boost::filesystem::path& dirIn, size_t nMaxMemoryIn) :
+    dir(dirIn), nMaxMemory(nMaxMemoryIn), nMemoryUsage(0), nRuns(0), nSyncedRuns(0), pjournal(NULL), nJournalSize(0)
+{
+}
+
+CDBBulkLoader::~CDBBulkLoader()
+{
+    CloseJournal();
+}
+
+boost::filesystem::path CDBBulkLoader::GetRunPath(int nRun) const
+{
+    return dir / strprintf("run%05u.dat", nRun);
+}
+
+boost::filesystem::path CDBBulkLoader::GetJournalPath(int nRun) const
+{
+    return dir / strprintf("journal%05u.dat", nRun);
+}
+
+bool CDBBulkLoader::OpenJournal(bool fAppend)
+{
+    boost::filesystem::path path = GetJournalPath(nRuns);
+    FILE* file = fopen(path.string().c_str(), fAppend ? "ab" : "wb");
+    if (!file)
+        return error("%s: cannot open %s", __func__, path.string());
+    pjournal = new CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    return true;
+}
+
+void CDBBulkLoader::CloseJournal()
+{
+    delete pjournal;
+    pjournal = NULL;
+}
+
+bool CDBBulkLoader::Start()
+{
+    CloseJournal();
+    vEntries.clear();
+    nMemoryUsage = 0;
+    nRuns = nSyncedRuns = 0;
+    nJournalSize = 0;
+    try {
+        boost::filesystem::remove_all(dir);
+        boost::filesystem::create_directories(dir);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return OpenJournal(false);
+}
+
+bool CDBBulkLoader::Resume(const Position& pos)
+{
+    CloseJournal();
+    vEntries.clear();
+    nMemoryUsage = 0;
+    nRuns = nSyncedRuns = pos.first;
+    nJournalSize = 0;
+    boost::filesystem::path pathJournal = GetJournalPath(nRuns);
+    try {
+        // Runs and journals from after the position are rebuilt from its journal
+        for (boost::filesystem::directory_iterator it(dir); it != boost::filesystem::directory_iterator(); it++) {
+            std::string strFile = it->path().filename().string();
+            int nRun;
+            if (it->path().extension() != ".dat" ||
+                (sscanf(strFile.c_str(), "run%d", &nRun) == 1 && nRun >= nRuns) ||
+                (sscanf(strFile.c_str(), "journal%d", &nRun) == 1 && nRun != nRuns)) {
+                boost::filesystem::remove(it->path());
+            }
+        }
+        if (pos.second > 0) {
+            FILE* file = fopen(pathJournal.string().c_str(), "rb");
+            if (!file)
+                return error("%s: cannot open %s", __func__, pathJournal.string());
+            CAutoFile journal(file, SER_DISK, CLIENT_VERSION);
+            while (nJournalSize < pos.second) {
+                Entry entry;
+                journal >> entry;
+                nJournalSize += ::GetSerializeSize(entry, SER_DISK, CLIENT_VERSION);
+                nMemoryUsage += entry.strKey.size() + entry.strValue.size() + sizeof(Entry);
+                vEntries.push_back(std::move(entry));
+            }
+            journal.fclose();
+            if (nJournalSize != pos.second)
+                return error("%s: %s does not end at a record boundary", __func__, pathJournal.string());
+            boost::filesystem::resize_file(pathJournal, pos.second);
+        }
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    if (!OpenJournal(pos.second > 0))
+        return false;
+    if (nMemoryUsage >= nMaxMemory)
+        return WriteRun();
+    return true;
+}
+
+bool CDBBulkLoader::Add(Entry& entry)
+{
+    try {
+        *pjournal << entry;
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    nJournalSize += ::GetSerializeSize(entry, SER_DISK, CLIENT_VERSION);
+    nMemoryUsage += entry.strKey.size() + entry.strValue.size() + sizeof(Entry);
+    vEntries.push_back(std::move(entry));
+    if (nMemoryUsage >= nMaxMemory)
+        return WriteRun();
+    return true;
+}
+
+bool CDBBulkLoader::WriteRun()
+{
+    // Keep only the last operation on each key; the sort must be stable for that
+    std::stable_sort(vEntries.begin(), vEntries.end(), [](const Entry& a, const Entry& b) { return a.strKey < b.strKey; });
+    size_t nKept = 0;
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        if (i + 1 < vEntries.size() && vEntries[i + 1].strKey == vEntries[i].strKey)
+            continue;
+        if (nKept != i)
+            std::swap(vEntries[nKept], vEntries[i]);
+        nKept++;
+    }
+    vEntries.resize(nKept);
+
+    boost::filesystem::path pathTmp = dir / strprintf("run%05u.tmp", nRuns);
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("%s: cannot open %s", __func__, pathTmp.string());
+    try {
+        CAutoFile run(file, SER_DISK, CLIENT_VERSION);
+        run << (uint64_t)vEntries.size();
+        BOOST_FOREACH(const Entry& entry, vEntries)
+            run << entry;
+        FileCommit(run.Get());
+        run.fclose();
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    if (!RenameOver(pathTmp, GetRunPath(nRuns)))
+        return error("%s: cannot rename %s", __func__, pathTmp.string());
+    LogPrint("db", "Wrote bulk load run %d with %u keys\n", nRuns, vEntries.size());
+
+    // The journal of this run is kept until a position past it is stored
+    CloseJournal();
+    nRuns++;
+    nJournalSize = 0;
+    vEntries.clear();
+    nMemoryUsage = 0;
+    return OpenJournal(false);
+}
+
+bool CDBBulkLoader::Sync(Position& pos)
+{
+    if (pjournal)
+        FileCommit(pjournal->Get());
+    pos = std::make_pair(nRuns, nJournalSize);
+    nSyncedRuns = nRuns;
+    return true;
+}
+
+void CDBBulkLoader::Committed()
+{
+    for (int nRun = 0; nRun < nSyncedRuns; nRun++)
+        boost::filesystem::remove(GetJournalPath(nRun));
+}
+
+bool CDBBulkLoader::Finish(CDBWrapper& db)
+{
+    if (!vEntries.empty() && !WriteRun())
+        return false;
+    CloseJournal();
+
+    std::vector<boost::filesystem::path> vPaths;
+    for (int nRun = 0; nRun < nRuns; nRun++)
+        vPaths.push_back(GetRunPath(nRun));
+    LogPrintf("Bulk loading %d sorted runs from %s\n", nRuns, dir.string());
+
+    CDBRunMerger merger;
+    if (!merger.Open(vPaths))
+        return false;
+    while (merger.Valid()) {
+        const char chPrefix = merger.Get().strKey[0];
+        CDBBulkLoadIterator it(merger, chPrefix);
+        leveldb::Status status = db.pdb->BulkLoad(&it);
+        if (status.IsNotSupportedError()) {
+            // The merger has already moved past this range, so merge it again.
+            // Keys of the range may already be in the database, so erases
+            // are written too.
+            LogPrintf("%s: %s, writing keys with prefix 0x%02x in batches\n", __func__, status.ToString(), (unsigned char)chPrefix);
+            CDBRunMerger rewrite;
+            if (!rewrite.Open(vPaths))
+                return false;
+            while (rewrite.Valid() && (unsigned char)rewrite.Get().strKey[0] < (unsigned char)chPrefix)
+                rewrite.Next();
+            leveldb::WriteBatch batch;
+            size_t nBatchSize = 0;
+            for (; rewrite.Valid() && rewrite.Get().strKey[0] == chPrefix; rewrite.Next()) {
+                if (rewrite.Get().fErase)
+                    batch.Delete(rewrite.Get().strKey);
+                else
+                    batch.Put(rewrite.Get().strKey, rewrite.Get().strValue);
+                nBatchSize += rewrite.Get().strKey.size() + rewrite.Get().strValue.size();
+                if (nBatchSize >= (16 << 20)) {
+                    dbwrapper_private::HandleError(db.pdb->Write(db.writeoptions, &batch));
+                    batch.Clear();
+                    nBatchSize = 0;
+                }
+            }
+            if (!rewrite.GetError().empty())
+                return error("%s: %s", __func__, rewrite.GetError());
+            dbwrapper_private::HandleError(db.pdb->Write(db.syncoptions, &batch));
+        } else if (!status.ok()) {
+            return error("%s: %s", __func__, status.ToString());
+        }
+    }
+    if (!merger.GetError().empty())
+        return error("%s: %s", __func__, merger.GetError());
+
+    try {
+        boost::filesystem::remove_all(dir);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    nRuns = nSyncedRuns = 0;
+    return true;
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
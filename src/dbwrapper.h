@@ -20,6 +20,80 @@
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+//! Default LevelDB table block size, in bytes
+static const size_t DEFAULT_DB_BLOCK_SIZE = 4096;
+//! Default bloom filter bits per key
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+//! Default number of table files LevelDB keeps open per database
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+//! Default number of level-0 files at which LevelDB slows down, then stops, writes
+static const int DEFAULT_DB_L0_SLOWDOWN = 8;
+static const int DEFAULT_DB_L0_STOP = 12;
+//! Default number of threads a single LevelDB compaction may use
+static const int DEFAULT_DB_SUBCOMPACTIONS = 1;
+
+/**
+ * LevelDB settings for one database. The defaults split the cache budget as
+ * half block cache and a quarter write buffer; a database may adjust them,
+ * and operators can override any setting with
+ * -dbprofile=<name>:<setting>=<value> (see ApplyDBProfileArgs).
+ */
+struct CDBProfile
+{
+    //! Name used by -dbprofile and getdbstats; empty for unnamed databases
+    std::string strName;
+    //! Size of the LRU cache for uncompressed table blocks, in bytes
+    size_t nBlockCacheSize;
+    //! Size of the memtable, in bytes; up to two may be held in memory simultaneously
+    size_t nWriteBufferSize;
+    //! Approximate amount of uncompressed data per table block, in bytes
+    size_t nBlockSize;
+    //! Bloom filter bits per key, or 0 for no filter
+    int nBloomBits;
+    //! Number of table files kept open at once
+    int nMaxOpenFiles;
+    //! Compress table blocks (if LevelDB was built with snappy)
+    bool fCompression;
+    //! Number of level-0 files at which writes are delayed, and at which they wait for compaction
+    int nL0Slowdown;
+    int nL0Stop;
+    //! Threads a single compaction may be split across
+    int nSubcompactions;
+
+    CDBProfile(const std::string& strNameIn, size_t nCacheSize);
+
+    /** Favour sustained bulk writes (reindex, index building) over read latency. */
+    void SetBulkWrites();
+};
+
+/** Override settings of profile with the matching -dbprofile options. */
+void ApplyDBProfileArgs(CDBProfile& profile);
+
+/** Check the syntax of all -dbprofile options. */
+bool CheckDBProfileArgs(std::string& strError);
+
+/** File descriptors the -dbprofile options ask for beyond the default open file limits. */
+int GetDBProfileExtraFiles();
+
+/** Internal LevelDB counters of one database. */
+struct CDBStats
+{
+    std::string strName;
+    std::vector<int> vFilesPerLevel;
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+    int64_t nWriteSlowdowns;
+    int64_t nMemtableWaits;
+    int64_t nLevel0Waits;
+    int64_t nStallMicros;
+    int64_t nCompactionMicros;
+    int64_t nCompactionBytesRead;
+    int64_t nCompactionBytesWritten;
+};
+
+/** Counters of every open named database. */
+std::vector<CDBStats> GetDBStats();
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
@@ -27,6 +101,7 @@ public:
 };
 
 class CDBWrapper;
+class CDBBlockCache;
 
 /** These should be considered an implementation detail of the specific database.
  */
@@ -167,6 +242,12 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! settings the database was opened with
+    CDBProfile profile;
+
+    //! block cache, counting hits and misses (owned through options.block_cache)
+    CDBBlockCache* pblockcache;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -175,8 +256,18 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      */
     CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    /**
+     * @param[in] path        Location in the filesystem where leveldb data will be stored.
+     * @param[in] profileIn   LevelDB settings; named databases are listed by getdbstats.
+     * @param[in] fMemory     If true, use leveldb's memory environment.
+     * @param[in] fWipe       If true, remove all existing data.
+     */
+    CDBWrapper(const boost::filesystem::path& path, const CDBProfile& profileIn, bool fMemory = false, bool fWipe = false);
     ~CDBWrapper();
 
+    /** Read LevelDB's internal counters for this database. */
+    CDBStats GetStats() const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
@@ -260,6 +351,114 @@ public:
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    friend class CDBBulkLoader;
+};
+
+/**
+ * Collects writes and erases for key ranges that are still empty in a
+ * database, as when an index is rebuilt from scratch, and adds the result
+ * straight to LevelDB's last level instead of passing it through the
+ * memtable and repeated compactions.
+ *
+ * Operations are buffered in memory and appended to a journal. When the
+ * buffer is full it is sorted into a run file and a new journal is started.
+ * Sync() makes everything so far durable and returns a position that the
+ * caller stores along with the state the operations belong to; Resume()
+ * continues from that position after a restart. As in a batch, later
+ * operations on a key override earlier ones.
+ */
+class CDBBulkLoader
+{
+public:
+    //! Number of complete runs and size of the journal, in bytes
+    typedef std::pair<int, uint64_t> Position;
+
+    struct Entry
+    {
+        std::string strKey;
+        std::string strValue;
+        bool fErase;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(fErase);
+            READWRITE(strKey);
+            READWRITE(strValue);
+        }
+    };
+
+private:
+    boost::filesystem::path dir;
+    size_t nMaxMemory;
+    size_t nMemoryUsage;
+    int nRuns;
+    int nSyncedRuns;
+    CAutoFile* pjournal;
+    uint64_t nJournalSize;
+    std::vector<Entry> vEntries;
+
+    boost::filesystem::path GetRunPath(int nRun) const;
+    boost::filesystem::path GetJournalPath(int nRun) const;
+    bool OpenJournal(bool fAppend);
+    bool Add(Entry& entry);
+    bool WriteRun();
+    void CloseJournal();
+
+public:
+    /**
+     * @param[in] dirIn        Directory for the runs and journals, used by this loader only.
+     * @param[in] nMaxMemoryIn Size of the in-memory buffer, in bytes.
+     */
+    CDBBulkLoader(const boost::filesystem::path& dirIn, size_t nMaxMemoryIn);
+    ~CDBBulkLoader();
+
+    /** Start from nothing, removing anything left in the directory. */
+    bool Start();
+
+    /** Continue from a position returned by Sync(), dropping everything after it. */
+    bool Resume(const Position& pos);
+
+    template <typename K, typename V>
+    bool Write(const K& key, const V& value)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue << value;
+        Entry entry;
+        entry.strKey.assign(ssKey.begin(), ssKey.end());
+        entry.strValue.assign(ssValue.begin(), ssValue.end());
+        entry.fErase = false;
+        return Add(entry);
+    }
+
+    template <typename K>
+    bool Erase(const K& key)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        Entry entry;
+        entry.strKey.assign(ssKey.begin(), ssKey.end());
+        entry.fErase = true;
+        return Add(entry);
+    }
+
+    /** Flush the journal to disk and return the position to resume from. */
+    bool Sync(Position& pos);
+
+    /** Remove journals that runs have replaced; call once the last position from Sync() is stored. */
+    void Committed();
+
+    /**
+     * Merge everything into db, one LevelDB bulk load per leading key byte,
+     * and remove the directory. Ranges LevelDB cannot bulk load are written
+     * in ordinary batches. No other writes to these ranges may happen
+     * meanwhile.
+     */
+    bool Finish(CDBWrapper& db);
 };
 
 #endif // BITCOIN_DBWRAPPER_H
@@ -1,5 +1,6 @@
 #include "gmock/gmock.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "pubkey.h"
 #include "vidulum/JoinSplit.hpp"
@@ -21,6 +22,7 @@ ZCJoinSplit* params;
 
 int main(int argc, char **argv) {
   assert(init_and_check_sodium() != -1);
+  SHA256AutoDetect();
   ECC_Start();
 
   libsnark::default_r1cs_ppzksnark_pp::init_public_params();
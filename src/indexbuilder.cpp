@@ -0,0 +1,385 @@
+// Copyright (c) 2018 The Vidulum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexbuilder.h"
+
+#include "chain.h"
+#include "main.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Blocks each worker thread reads per round
+const size_t BLOCKS_PER_THREAD = 16;
+
+std::atomic<int> nBuildingIndexes(0);
+std::atomic<int> nBuiltHeight(-1);
+
+/** Index entries of one block, in the order ConnectBlock or DisconnectBlock produces them */
+struct CBlockIndexEntries
+{
+    std::vector<std::pair<uint256, CDiskTxPos> > vTxPos;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+};
+
+bool GetScriptAddress(const CScript& script, uint160& hashBytes, int& nType)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+2, script.begin()+22));
+        nType = 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+3, script.begin()+23));
+        nType = 1;
+    } else {
+        hashBytes.SetNull();
+        nType = 0;
+    }
+    return nType > 0;
+}
+
+/** The entries ConnectBlock writes for a block, taking the spent outputs from its undo data */
+void GetConnectEntries(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, int nIndexes, CBlockIndexEntries& entries)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        uint160 hashBytes;
+        int nType;
+
+        if (i > 0 && (nIndexes & (INDEX_BUILD_ADDRESS | INDEX_BUILD_SPENT))) {
+            const CTxUndo& txundo = blockundo.vtxundo[i-1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const CTxOut& out = txundo.vprevout[j].txout;
+                if (GetScriptAddress(out.scriptPubKey, hashBytes, nType) && (nIndexes & INDEX_BUILD_ADDRESS)) {
+                    entries.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, j, true), out.nValue * -1));
+                    entries.vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                }
+                if (nIndexes & INDEX_BUILD_SPENT)
+                    entries.vSpent.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, out.nValue, nType, hashBytes)));
+            }
+        }
+
+        if (nIndexes & INDEX_BUILD_ADDRESS) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                if (!GetScriptAddress(out.scriptPubKey, hashBytes, nType))
+                    continue;
+                entries.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+                entries.vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+            }
+        }
+
+        if (nIndexes & INDEX_BUILD_TX) {
+            entries.vTxPos.push_back(std::make_pair(txhash, pos));
+            pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+    }
+}
+
+/** The entries DisconnectBlock erases or restores for a block; vAddressIndex lists keys to erase */
+void GetDisconnectEntries(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, int nIndexes, CBlockIndexEntries& entries)
+{
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        uint160 hashBytes;
+        int nType;
+
+        if (nIndexes & INDEX_BUILD_ADDRESS) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut& out = tx.vout[k];
+                if (!GetScriptAddress(out.scriptPubKey, hashBytes, nType))
+                    continue;
+                entries.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+                entries.vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue()));
+            }
+        }
+
+        if (i == 0)
+            continue;
+        const CTxUndo& txundo = blockundo.vtxundo[i-1];
+        for (unsigned int j = tx.vin.size(); j-- > 0;) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const CTxInUndo& undo = txundo.vprevout[j];
+            if (nIndexes & INDEX_BUILD_SPENT)
+                entries.vSpent.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue()));
+            if ((nIndexes & INDEX_BUILD_ADDRESS) && GetScriptAddress(undo.txout.scriptPubKey, hashBytes, nType)) {
+                entries.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, j, true), undo.txout.nValue * -1));
+                entries.vAddressUnspent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, undo.nHeight)));
+            }
+        }
+    }
+}
+
+/** Read a block and its undo data from disk and collect its index entries */
+bool ReadBlockEntries(const CBlockIndex* pindex, int nIndexes, bool fDisconnect, CBlockIndexEntries& entries)
+{
+    if (!(nIndexes & (INDEX_BUILD_TX | INDEX_BUILD_ADDRESS | INDEX_BUILD_SPENT)))
+        return true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s: cannot read block %s", __func__, pindex->GetBlockHash().ToString());
+
+    CBlockUndo blockundo;
+    if (nIndexes & (INDEX_BUILD_ADDRESS | INDEX_BUILD_SPENT)) {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull() || !UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash()))
+            return error("%s: cannot read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s: block %s and its undo data are inconsistent", __func__, pindex->GetBlockHash().ToString());
+        for (unsigned int i = 1; i < block.vtx.size(); i++) {
+            if (blockundo.vtxundo[i-1].vprevout.size() != block.vtx[i]->vin.size())
+                return error("%s: transaction %s and its undo data are inconsistent", __func__, block.vtx[i]->GetHash().ToString());
+        }
+    }
+
+    if (fDisconnect)
+        GetDisconnectEntries(block, blockundo, pindex, nIndexes, entries);
+    else
+        GetConnectEntries(block, blockundo, pindex, nIndexes, entries);
+    return true;
+}
+
+/** Write the entries of consecutive blocks, keeping their order */
+bool WriteEntries(const std::vector<CBlockIndexEntries>& vEntries, bool fDisconnect)
+{
+    CBlockIndexEntries all;
+    BOOST_FOREACH(const CBlockIndexEntries& entries, vEntries) {
+        all.vTxPos.insert(all.vTxPos.end(), entries.vTxPos.begin(), entries.vTxPos.end());
+        all.vAddressIndex.insert(all.vAddressIndex.end(), entries.vAddressIndex.begin(), entries.vAddressIndex.end());
+        all.vAddressUnspent.insert(all.vAddressUnspent.end(), entries.vAddressUnspent.begin(), entries.vAddressUnspent.end());
+        all.vSpent.insert(all.vSpent.end(), entries.vSpent.begin(), entries.vSpent.end());
+    }
+
+    if (!all.vTxPos.empty() && !pblocktree->WriteTxIndex(all.vTxPos))
+        return false;
+    if (!all.vAddressIndex.empty()) {
+        if (!(fDisconnect ? pblocktree->EraseAddressIndex(all.vAddressIndex) : pblocktree->WriteAddressIndex(all.vAddressIndex)))
+            return false;
+    }
+    if (!all.vAddressUnspent.empty() && !pblocktree->UpdateAddressUnspentIndex(all.vAddressUnspent))
+        return false;
+    if (!all.vSpent.empty() && !pblocktree->UpdateSpentIndex(all.vSpent))
+        return false;
+    return true;
+}
+
+/** Assign the block its logical timestamp the same way ConnectBlock does */
+bool WriteTimestamp(const CBlockIndex* pindex)
+{
+    unsigned int logicalTS = pindex->nTime;
+    unsigned int prevLogicalTS = 0;
+    // The genesis block has no logical timestamp; every later block must
+    if (pindex->pprev && pindex->pprev->pprev &&
+        !pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+        return error("%s: no logical timestamp for block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+    if (logicalTS <= prevLogicalTS)
+        logicalTS = prevLogicalTS + 1;
+
+    return pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())) &&
+           pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS));
+}
+
+void ReadBlocks(const std::vector<const CBlockIndex*>& vBlocks, int nIndexes, std::vector<CBlockIndexEntries>& vEntries,
+                std::atomic<size_t>& nNext, std::atomic<bool>& fFailed)
+{
+    size_t i;
+    while (!fFailed && (i = nNext++) < vBlocks.size()) {
+        try {
+            if (!ReadBlockEntries(vBlocks[i], nIndexes, false, vEntries[i]))
+                fFailed = true;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            fFailed = true;
+        }
+    }
+}
+
+/** Turn the built indexes on; from here on ConnectBlock maintains them */
+bool EnableIndexes(int nIndexes)
+{
+    AssertLockHeld(cs_main);
+    if (nIndexes & INDEX_BUILD_TX) {
+        if (!pblocktree->WriteFlag("txindex", true))
+            return false;
+        fTxIndex = true;
+    }
+    if (nIndexes & INDEX_BUILD_ADDRESS) {
+        if (!pblocktree->WriteFlag("addressindex", true))
+            return false;
+        fAddressIndex = true;
+    }
+    if (nIndexes & INDEX_BUILD_SPENT) {
+        if (!pblocktree->WriteFlag("spentindex", true))
+            return false;
+        fSpentIndex = true;
+    }
+    if (nIndexes & INDEX_BUILD_TIMESTAMP) {
+        if (!pblocktree->WriteFlag("timestampindex", true))
+            return false;
+        fTimestampIndex = true;
+    }
+    return pblocktree->EraseIndexBuild();
+}
+
+std::vector<std::string> GetIndexNames(int nIndexes)
+{
+    std::vector<std::string> vNames;
+    if (nIndexes & INDEX_BUILD_TX)
+        vNames.push_back("txindex");
+    if (nIndexes & INDEX_BUILD_ADDRESS)
+        vNames.push_back("addressindex");
+    if (nIndexes & INDEX_BUILD_SPENT)
+        vNames.push_back("spentindex");
+    if (nIndexes & INDEX_BUILD_TIMESTAMP)
+        vNames.push_back("timestampindex");
+    return vNames;
+}
+
+bool BuildIndexes(int nIndexes, int nThreads)
+{
+    const CBlockIndex* pindexBuilt = NULL;
+    {
+        LOCK(cs_main);
+        // Resume an interrupted build of the same indexes
+        int nStoredIndexes;
+        uint256 hashBuilt;
+        if (pblocktree->ReadIndexBuild(nStoredIndexes, hashBuilt) && nStoredIndexes == nIndexes) {
+            BlockMap::iterator mi = mapBlockIndex.find(hashBuilt);
+            if (mi != mapBlockIndex.end())
+                pindexBuilt = mi->second;
+        }
+        if (!pindexBuilt) {
+            // ConnectBlock skips the genesis block, so there is nothing to index in it
+            pindexBuilt = chainActive.Genesis();
+            if (!pblocktree->WriteIndexBuild(nIndexes, pindexBuilt->GetBlockHash()))
+                return false;
+        }
+    }
+    nBuiltHeight = pindexBuilt->nHeight;
+    LogPrintf("Building %s from height %d with %d threads\n", boost::algorithm::join(GetIndexNames(nIndexes), ", "), pindexBuilt->nHeight, nThreads);
+
+    int64_t nStart = GetTimeMillis();
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        std::vector<const CBlockIndex*> vBlocks;
+        {
+            LOCK(cs_main);
+            if (!chainActive.Contains(pindexBuilt)) {
+                // Blocks that were already indexed have been disconnected
+                const CBlockIndex* pindexFork = chainActive.FindFork(pindexBuilt);
+                for (const CBlockIndex* pindex = pindexBuilt; pindex != pindexFork; pindex = pindex->pprev) {
+                    std::vector<CBlockIndexEntries> vEntries(1);
+                    if (!ReadBlockEntries(pindex, nIndexes & ~INDEX_BUILD_TX, true, vEntries[0]) || !WriteEntries(vEntries, true))
+                        return false;
+                }
+                LogPrint("index", "%s: rewound from height %d to %d\n", __func__, pindexBuilt->nHeight, pindexFork->nHeight);
+                pindexBuilt = pindexFork;
+                if (!pblocktree->WriteIndexBuild(nIndexes, pindexBuilt->GetBlockHash()))
+                    return false;
+            }
+            for (const CBlockIndex* pindex = chainActive.Next(pindexBuilt); pindex && vBlocks.size() < nThreads * BLOCKS_PER_THREAD; pindex = chainActive.Next(pindex))
+                vBlocks.push_back(pindex);
+            if (vBlocks.empty()) {
+                // Caught up with the tip while holding cs_main, so no block can be missed
+                if (!EnableIndexes(nIndexes))
+                    return false;
+                break;
+            }
+        }
+
+        std::vector<CBlockIndexEntries> vEntries(vBlocks.size());
+        std::atomic<size_t> nNext(0);
+        std::atomic<bool> fFailed(false);
+        {
+            boost::thread_group workers;
+            for (int i = 1; i < nThreads; i++)
+                workers.create_thread([&] { ReadBlocks(vBlocks, nIndexes, vEntries, nNext, fFailed); });
+            ReadBlocks(vBlocks, nIndexes, vEntries, nNext, fFailed);
+            // The workers use this frame, so wait for them even on shutdown
+            boost::this_thread::disable_interruption di;
+            workers.join_all();
+        }
+        if (fFailed || !WriteEntries(vEntries, false))
+            return false;
+        if (nIndexes & INDEX_BUILD_TIMESTAMP) {
+            BOOST_FOREACH(const CBlockIndex* pindex, vBlocks) {
+                if (!WriteTimestamp(pindex))
+                    return false;
+            }
+        }
+
+        pindexBuilt = vBlocks.back();
+        if (!pblocktree->WriteIndexBuild(nIndexes, pindexBuilt->GetBlockHash()))
+            return false;
+        nBuiltHeight = pindexBuilt->nHeight;
+    }
+
+    LogPrintf("Built %s up to height %d in %ds\n", boost::algorithm::join(GetIndexNames(nIndexes), ", "), pindexBuilt->nHeight, (GetTimeMillis() - nStart) / 1000);
+    return true;
+}
+
+}
+
+int GetMissingIndexes()
+{
+    int nIndexes = 0;
+    if (GetBoolArg("-txindex", false) && !fTxIndex)
+        nIndexes |= INDEX_BUILD_TX;
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) && !fAddressIndex)
+        nIndexes |= INDEX_BUILD_ADDRESS;
+    if (GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) && !fSpentIndex)
+        nIndexes |= INDEX_BUILD_SPENT;
+    if (GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX) && !fTimestampIndex)
+        nIndexes |= INDEX_BUILD_TIMESTAMP;
+    return nIndexes;
+}
+
+void ThreadBuildIndexes(int nIndexes)
+{
+    RenameThread("vidulum-index");
+
+    int nThreads = GetArg("-indexthreads", DEFAULT_INDEX_BUILD_THREADS);
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    nThreads = std::max(1, std::min(nThreads, MAX_INDEX_BUILD_THREADS));
+
+    nBuildingIndexes = nIndexes;
+    try {
+        if (!BuildIndexes(nIndexes, nThreads))
+            LogPrintf("Error: building %s failed, it will be retried on the next start\n", boost::algorithm::join(GetIndexNames(nIndexes), ", "));
+    } catch (const boost::thread_interrupted&) {
+        LogPrintf("Building %s interrupted at height %d\n", boost::algorithm::join(GetIndexNames(nIndexes), ", "), nBuiltHeight.load());
+        nBuildingIndexes = 0;
+        throw;
+    } catch (const std::exception& e) {
+        // A database error must not take the node down with it
+        LogPrintf("Error: building %s failed (%s), it will be retried on the next start\n", boost::algorithm::join(GetIndexNames(nIndexes), ", "), e.what());
+    }
+    nBuildingIndexes = 0;
+}
+
+bool GetIndexBuildProgress(std::vector<std::string>& vIndexes, int& nHeight)
+{
+    int nIndexes = nBuildingIndexes;
+    if (nIndexes == 0)
+        return false;
+    vIndexes = GetIndexNames(nIndexes);
+    nHeight = nBuiltHeight;
+    return true;
+}
@@ -0,0 +1,41 @@
+// Copyright (c) 2018 The Vidulum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEXBUILDER_H
+#define BITCOIN_INDEXBUILDER_H
+
+#include <string>
+#include <vector>
+
+/** Optional block tree indexes that can be built in the background */
+enum IndexBuildFlags {
+    INDEX_BUILD_TX = (1 << 0),
+    INDEX_BUILD_ADDRESS = (1 << 1),
+    INDEX_BUILD_SPENT = (1 << 2),
+    INDEX_BUILD_TIMESTAMP = (1 << 3),
+};
+
+//! -indexthreads default, 0 = one per core
+static const int DEFAULT_INDEX_BUILD_THREADS = 0;
+//! Maximum number of -indexthreads
+static const int MAX_INDEX_BUILD_THREADS = 16;
+
+/**
+ * Indexes enabled on the command line that the block tree database does
+ * not have yet. Call after the block index is loaded.
+ */
+int GetMissingIndexes();
+
+/**
+ * Build the given indexes from the block and undo files of the active chain
+ * without validating the blocks again, then turn them on. Blocks are read
+ * and decoded by -indexthreads worker threads; the node keeps running, and
+ * an interrupted build resumes where it stopped on the next start.
+ */
+void ThreadBuildIndexes(int nIndexes);
+
+/** Names of the indexes being built and the height they have reached; false if none are */
+bool GetIndexBuildProgress(std::vector<std::string>& vIndexes, int& nHeight);
+
+#endif // BITCOIN_INDEXBUILDER_H
@@ -13,24 +13,29 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockstore.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexbuilder.h"
 #include "key.h"
 #ifdef ENABLE_MINING
 #include "key_io.h"
 #endif
 #include "main.h"
 #include "masternode-budget.h"
+#include "masternode-paymentdb.h"
 #include "masternode-payments.h"
 #include "masternodeconfig.h"
 #include "masternodeman.h"
 #include "metrics.h"
 #include "miner.h"
 #include "net.h"
+#include "obfuscation.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "script/standard.h"
@@ -47,6 +52,7 @@
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
+#include <atomic>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -69,6 +75,8 @@
 
 #if ENABLE_ZMQ
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqpublishnotifier.h"
+#include "zmq/zmqrpc.h"
 #endif
 
 #if ENABLE_PROTON
@@ -87,6 +95,8 @@ ZCJoinSplit* pvidulumParams = NULL;
 CWallet* pwalletMain = NULL;
 #endif
 bool fFeeEstimatesInitialized = false;
+//! Set once ThreadImport has loaded mempool.dat, so a shutdown during the load keeps the file
+static std::atomic<bool> fDumpMempoolLater(false);
 
 #if ENABLE_ZMQ
 static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
@@ -221,8 +231,14 @@ void Shutdown()
     StopTorControl();
     DumpMasternodes();
     DumpBudgets();
-    DumpMasternodePayments();
+    delete pmnpaymentsdb;
+    pmnpaymentsdb = NULL;
     UnregisterNodeSignals(GetNodeSignals());
+    // Let ZMQ/AMQP publishers catch up while the chain state is still around
+    SyncWithValidationInterfaceQueues();
+
+    if (fDumpMempoolLater && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
 
     if (fFeeEstimatesInitialized)
     {
@@ -364,10 +380,20 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-daemon", _("Run in the background as a daemon and accept commands"));
 #endif
     }
+    strUsage += HelpMessageOpt("-blockcache=<n>", strprintf(_("Keep up to <n> megabytes of recently read blocks in memory (0 to disable, default: %d)"), DEFAULT_BLOCK_CACHE_SIZE));
+    strUsage += HelpMessageOpt("-bulkindex=<n>", strprintf(_("When reindexing, build the address, spent and timestamp indexes from sorted runs of up to <n> megabytes "
+        "and load them into the database at the end (0 to write them block by block, default: %d)"), nDefaultBulkIndexMemory));
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbprofile=<db>:<setting>=<n>", _("Tune the LevelDB database <db> (chainstate, blockindex, sporks or mnpayments). <setting> is one of "
+        "blockcache and writebuffer (in megabytes, default: from -dbcache), blocksize (in bytes), bloombits (0 disables the bloom filter), "
+        "maxopenfiles, compression (0 or 1), l0slowdown and l0stop (level-0 files at which writes slow down and stop) "
+        "or subcompactions (threads per compaction). Can be specified multiple times"));
+    strUsage += HelpMessageOpt("-indexthreads=<n>", strprintf(_("Set the number of threads that build a newly enabled -txindex, -addressindex, -spentindex or -timestampindex "
+        "in the background (up to %d, 0 = one per core, default: %d)"), MAX_INDEX_BUILD_THREADS, DEFAULT_INDEX_BUILD_THREADS));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("[DEPRECATED FROM OVERWINTER] Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
@@ -375,6 +401,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "vidulumd.pid"));
 #endif
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet support and is incompatible with -txindex. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
@@ -452,6 +479,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubqueuesize=<n>", strprintf(_("Drop notifications once <n> messages are waiting to be published (default: %u)"), DEFAULT_ZMQ_PUB_QUEUE_SIZE));
+    strUsage += HelpMessageOpt("-zmqpubhashtxbatch=<n>", strprintf(_("Send up to <n> queued transaction hashes in one hashtx message; sequence numbers then advance by the number of hashes (default: %u)"), DEFAULT_ZMQ_PUB_HASHTX_BATCH));
 #endif
 
 #if ENABLE_PROTON
@@ -665,6 +694,22 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         InitBlockIndex();
     }
 
+    // Load the indexes collected during -reindex, including one interrupted
+    // by a shutdown after all blocks were connected. cs_main is held for the
+    // whole merge: a block connected meanwhile would add index entries to
+    // the runs being merged, and a flush would store a loader position that
+    // no longer exists.
+    if (pblocktree->IsBulkLoading()) {
+        LOCK(cs_main);
+        if (!pblocktree->FinishBulkLoad()) {
+            std::string strError = _("Failed to load the address, spent and timestamp indexes");
+            LogPrintf("*** %s\n", strError);
+            uiInterface.ThreadSafeMessageBox(strError, "", CClientUIInterface::MSG_ERROR);
+            StartShutdown();
+            return;
+        }
+    }
+
     // hardcoded $DATADIR/bootstrap.dat
     boost::filesystem::path pathBootstrap = GetDataDir() / "bootstrap.dat";
     if (boost::filesystem::exists(pathBootstrap)) {
@@ -696,6 +741,18 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        LoadMempool();
+        fDumpMempoolLater = !ShutdownRequested();
+    }
+
+    // Build indexes turned on for an existing datadir. Only now, as writes
+    // made during -reindex or the bulk load above would go to the loader
+    // without cs_main and could be reported built while not yet synced.
+    int nMissingIndexes = GetMissingIndexes();
+    if (nMissingIndexes && !ShutdownRequested())
+        ThreadBuildIndexes(nMissingIndexes);
 }
 
 /** Sanity checks
@@ -948,14 +1005,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             LogPrintf("AppInit2 : parameter interaction: -enableswifttx=false -> setting -nSwiftTXDepth=0\n");
     }
     // Make sure enough file descriptors are available
-    int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
+#ifdef USE_EPOLL
+    // epoll has no FD_SETSIZE ceiling; only the file descriptor limit below applies
+    nMaxConnections = std::max(nMaxConnections, 0);
+#else
+    int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
-    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+#endif
+    std::string strDBProfileError;
+    if (!CheckDBProfileArgs(strDBProfileError))
+        return InitError(strDBProfileError);
+    // Databases tuned to keep more files open than the default need their own descriptors
+    int nDBFileDescriptors = MIN_CORE_FILEDESCRIPTORS + GetDBProfileExtraFiles();
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + nDBFileDescriptors);
+    if (nFD < nDBFileDescriptors)
         return InitError(_("Not enough file descriptors available."));
-    if (nFD - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
-        nMaxConnections = nFD - MIN_CORE_FILEDESCRIPTORS;
+    if (nFD - nDBFileDescriptors < nMaxConnections)
+        nMaxConnections = nFD - nDBFileDescriptors;
 
     // if using block pruning, then disable txindex
     // also disable the wallet (for now, until SPV support is implemented in wallet)
@@ -1041,6 +1108,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (!fDisableWallet)
         RegisterWalletRPCCommands(tableRPC);
 #endif
+#if ENABLE_ZMQ
+    RegisterZMQRPCCommands(tableRPC);
+#endif
 
     nConnectTimeout = GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0)
@@ -1134,6 +1204,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 #endif
 
+    // A smaller pool would evict transactions before a block could take them
+    if (GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) < MIN_MAX_MEMPOOL_SIZE)
+        return InitError(strprintf(_("-maxmempool must be at least %d MB"), MIN_MAX_MEMPOOL_SIZE));
+
     // Default value of 0 for mempooltxinputlimit means no limit is applied
     if (mapArgs.count("-mempooltxinputlimit")) {
         int64_t limit = GetArg("-mempooltxinputlimit", 0);
@@ -1184,6 +1258,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1236,6 +1313,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadMessageSignerCheck);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1530,6 +1609,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    int64_t nBlockCache = std::max((int64_t)0, GetArg("-blockcache", DEFAULT_BLOCK_CACHE_SIZE)) << 20;
+    blockcache.SetMaxUsage(nBlockCache);
+    LogPrintf("* Using %.1fMiB for recently read blocks\n", nBlockCache * (1.0 / 1024 / 1024));
 
     bool clearWitnessCaches = false;
 
@@ -1563,6 +1645,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                         CleanupBlockRevFiles();
                 }
 
+                int64_t nBulkIndexMemory = GetArg("-bulkindex", nDefaultBulkIndexMemory) << 20;
+                if (fReindex && nBulkIndexMemory > 0 &&
+                    (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ||
+                     GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX))) {
+                    if (!pblocktree->StartBulkLoad(nBulkIndexMemory)) {
+                        strLoadError = _("Error opening block database");
+                        break;
+                    }
+                } else if (!fReindex && !pblocktree->ResumeBulkLoad(std::max(nBulkIndexMemory, nMinDbCache << 20))) {
+                    strLoadError = _("Error opening block database");
+                    break;
+                }
+
 				// Vidulum: load previous sessions sporks if we have them.
                 // uiInterface.InitMessage(_("Loading sporks..."));
                 LoadSporksFromDB();
@@ -1583,8 +1678,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", false)) {
+                // Check for changed -txindex state; a missing index is built in the background
+                if (fTxIndex && !GetBoolArg("-txindex", false)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
                     break;
                 }
@@ -1596,6 +1691,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Building an index needs every block of the active chain
+                if (fHavePruned && GetMissingIndexes()) {
+                    strLoadError = _("You need to rebuild the database using -reindex to enable an index on a pruned node");
+                    break;
+                }
+
                 if (!fReindex) {
                     uiInterface.InitMessage(_("Rewinding blocks if needed..."));
                     if (!RewindBlockIndex(chainparams, clearWitnessCaches)) {
@@ -1911,18 +2012,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     uiInterface.InitMessage(_("Loading masternode payment cache..."));
 
-    CMasternodePaymentDB mnpayments;
-    CMasternodePaymentDB::ReadResult readResult3 = mnpayments.Read(masternodePayments);
-
-    if (readResult3 == CMasternodePaymentDB::FileError)
-        LogPrintf("Missing masternode payment cache - mnpayments.dat, will try to recreate\n");
-    else if (readResult3 != CMasternodePaymentDB::Ok) {
-        LogPrintf("Error reading mnpayments.dat: ");
-        if (readResult3 == CMasternodePaymentDB::IncorrectFormat)
-            LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
-        else
-            LogPrintf("file format is unknown or invalid, please fix it manually\n");
+    // Votes are read back from the store as their heights are needed. They
+    // don't depend on our chain state, so a reindex keeps them.
+    try {
+        pmnpaymentsdb = new CMasternodePaymentVoteDB(1 << 21, false, false);
+    } catch (const std::exception& e) {
+        return InitError(strprintf(_("Error opening masternode payment vote database: %s"), e.what()));
     }
+    // The flat file the votes used to be kept in is superseded by the store,
+    // its votes are fetched from peers again
+    boost::filesystem::path pathOldPayments = GetDataDir() / "mnpayments.dat";
+    boost::system::error_code ec;
+    if (boost::filesystem::remove(pathOldPayments, ec))
+        LogPrintf("Removed obsolete %s\n", pathOldPayments.string());
 
     fMasterNode = GetBoolArg("-masternode", false);
 
@@ -2031,6 +2133,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     obfuScationPool.InitCollateralAddress();
 
     threadGroup.create_thread(boost::bind(&ThreadCheckObfuScationPool));
+    StartObfuScationMaintenance(scheduler);
 
     // ********************************************************* Step 11: start node
 
@@ -37,6 +37,9 @@ namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Size at which BulkLoad() starts a new table, as for compaction outputs
+static const uint64_t kBulkLoadTableSize = 2 * 1048576;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   Status status;
@@ -71,16 +74,45 @@ struct DBImpl::CompactionState {
 
   uint64_t total_bytes;
 
+  // Micros spent doing imm_ compactions while merging
+  int64_t imm_micros;
+
+  // Position in the inputs for Compaction::IsBaseLevelForKey() and
+  // Compaction::ShouldStopBefore()
+  Compaction::Cursor cursor;
+
+  // When the compaction is split, this state merges the user keys in
+  // (begin, end]; a missing bound means the range is open on that side.
+  bool has_begin;
+  bool has_end;
+  std::string begin;
+  std::string end;
+
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        total_bytes(0),
+        imm_micros(0),
+        has_begin(false),
+        has_end(false) {
   }
 };
 
+// One part of a split compaction, merged on its own thread
+struct DBImpl::SubcompactionJob {
+  DBImpl* db;
+  CompactionState* state;
+  Status status;
+
+  // Shared by all parts of the compaction: counts the threads still running
+  port::Mutex* mu;
+  port::CondVar* cv;
+  int* running;
+};
+
 // Fix user-supplied options to be reasonable
 template <class T,class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -97,6 +129,12 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.l0_compaction_trigger, 1, 1000);
+  ClipToRange(&result.l0_slowdown_writes_trigger,
+              result.l0_compaction_trigger, 1000);
+  ClipToRange(&result.l0_stop_writes_trigger,
+              result.l0_slowdown_writes_trigger, 1000);
+  ClipToRange(&result.max_subcompactions, 1, 64);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -133,9 +171,11 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       seed_(0),
       tmp_batch_(new WriteBatch),
       bg_compaction_scheduled_(false),
+      bulk_load_installing_(false),
       manual_compaction_(NULL) {
   mem_->Ref();
   has_imm_.Release_Store(NULL);
+  imm_compacting_.Release_Store(NULL);
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
@@ -550,6 +590,145 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+Status DBImpl::FinishBulkLoadTable(TableBuilder* builder, WritableFile* file,
+                                   FileMetaData* meta) {
+  Status s = builder->Finish();
+  meta->file_size = builder->FileSize();
+  if (s.ok()) {
+    s = file->Sync();
+  }
+  if (s.ok()) {
+    s = file->Close();
+  }
+  if (s.ok()) {
+    // Verify that the table is usable
+    Iterator* iter = table_cache_->NewIterator(ReadOptions(),
+                                               meta->number,
+                                               meta->file_size);
+    s = iter->status();
+    delete iter;
+  }
+  return s;
+}
+
+Status DBImpl::BulkLoad(Iterator* source) {
+  const uint64_t start_micros = env_->NowMicros();
+  const Comparator* ucmp = user_comparator();
+
+  // Build the tables without holding the lock, like a compaction
+  std::vector<FileMetaData> files;
+  WritableFile* file = NULL;
+  TableBuilder* builder = NULL;
+  std::string last_key;
+  std::string ikey;
+  Status s;
+  for (source->SeekToFirst(); source->Valid(); source->Next()) {
+    Slice key = source->key();
+    if (!files.empty() && ucmp->Compare(key, Slice(last_key)) <= 0) {
+      s = Status::InvalidArgument("BulkLoad keys are not increasing");
+      break;
+    }
+    last_key.assign(key.data(), key.size());
+
+    if (builder == NULL) {
+      FileMetaData meta;
+      mutex_.Lock();
+      meta.number = versions_->NewFileNumber();
+      pending_outputs_.insert(meta.number);
+      mutex_.Unlock();
+      files.push_back(meta);
+      s = env_->NewWritableFile(TableFileName(dbname_, meta.number), &file);
+      if (!s.ok()) {
+        break;
+      }
+      builder = new TableBuilder(options_, file);
+    }
+
+    // Sequence number zero sorts after, and so counts as older than,
+    // every other entry for the same user key.
+    ikey.clear();
+    AppendInternalKey(&ikey, ParsedInternalKey(key, 0, kTypeValue));
+    if (builder->NumEntries() == 0) {
+      files.back().smallest.DecodeFrom(ikey);
+    }
+    files.back().largest.DecodeFrom(ikey);
+    builder->Add(ikey, source->value());
+
+    if (builder->FileSize() >= kBulkLoadTableSize) {
+      s = FinishBulkLoadTable(builder, file, &files.back());
+      delete builder;
+      delete file;
+      builder = NULL;
+      file = NULL;
+      if (!s.ok()) {
+        break;
+      }
+    }
+  }
+  if (s.ok()) {
+    s = source->status();
+  }
+  if (builder != NULL) {
+    if (s.ok()) {
+      s = FinishBulkLoadTable(builder, file, &files.back());
+    } else {
+      builder->Abandon();
+    }
+    delete builder;
+  }
+  delete file;
+
+  MutexLock l(&mutex_);
+  if (s.ok() && !files.empty()) {
+    while (bg_compaction_scheduled_ || bulk_load_installing_) {
+      bg_cv_.Wait();
+    }
+    bulk_load_installing_ = true;
+
+    // Older entries live in deeper levels, so the new tables may only go
+    // below every file they overlap.
+    const int level = config::kNumLevels - 1;
+    Slice smallest_user_key = files.front().smallest.user_key();
+    Slice largest_user_key = files.back().largest.user_key();
+    if (!bg_error_.ok()) {
+      s = bg_error_;
+    } else if (versions_->current()->OverlapInLevel(level, &smallest_user_key,
+                                                    &largest_user_key)) {
+      s = Status::NotSupported("BulkLoad key range overlaps the last level");
+    } else {
+      VersionEdit edit;
+      CompactionStats stats;
+      for (size_t i = 0; i < files.size(); i++) {
+        edit.AddFile(level, files[i].number, files[i].file_size,
+                     files[i].smallest, files[i].largest);
+        stats.bytes_written += files[i].file_size;
+      }
+      s = versions_->LogAndApply(&edit, &mutex_);
+      if (!s.ok()) {
+        RecordBackgroundError(s);
+      }
+      stats.micros = env_->NowMicros() - start_micros;
+      stats_[level].Add(stats);
+      Log(options_.info_log, "Bulk loaded %d tables (%lld bytes) at level %d: %s",
+          static_cast<int>(files.size()),
+          static_cast<long long>(stats.bytes_written), level,
+          s.ToString().c_str());
+    }
+
+    bulk_load_installing_ = false;
+    bg_cv_.SignalAll();
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    pending_outputs_.erase(files[i].number);
+  }
+  if (!s.ok()) {
+    // Remove the tables that were not installed
+    DeleteObsoleteFiles();
+  }
+  MaybeScheduleCompaction();
+  return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
   assert(level >= 0);
   assert(level + 1 < config::kNumLevels);
@@ -619,6 +798,8 @@ void DBImpl::MaybeScheduleCompaction() {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
+  } else if (bulk_load_installing_) {
+    // BulkLoad() schedules compactions once its tables are installed
   } else if (imm_ == NULL &&
              manual_compaction_ == NULL &&
              !versions_->NeedsCompaction()) {
@@ -854,7 +1035,6 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0),
@@ -874,8 +1054,152 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  std::vector<std::string> split_keys;
+  if (options_.max_subcompactions > 1) {
+    compact->compaction->GetSplitKeys(options_.max_subcompactions,
+                                      &split_keys);
+  }
+  Status status;
+  if (split_keys.empty()) {
+    status = DoCompactionRange(compact);
+  } else {
+    status = DoSubcompactions(compact, split_keys);
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - compact->imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  mutex_.Lock();
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log,
+      "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::DoSubcompactions(CompactionState* compact,
+                                const std::vector<std::string>& split_keys) {
+  const size_t parts = split_keys.size() + 1;
+  Log(options_.info_log, "Splitting compaction into %d parts",
+      static_cast<int>(parts));
+
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int running = 0;
+  std::vector<SubcompactionJob> jobs(parts);
+  for (size_t i = 0; i < parts; i++) {
+    CompactionState* sub = new CompactionState(compact->compaction);
+    sub->smallest_snapshot = compact->smallest_snapshot;
+    if (i > 0) {
+      sub->has_begin = true;
+      sub->begin = split_keys[i - 1];
+    }
+    if (i < split_keys.size()) {
+      sub->has_end = true;
+      sub->end = split_keys[i];
+    }
+    jobs[i].db = this;
+    jobs[i].state = sub;
+    jobs[i].mu = &mu;
+    jobs[i].cv = &cv;
+    jobs[i].running = &running;
+  }
+
+  // Merge the first part on this thread and the others on threads of
+  // their own, then wait for all of them.
+  running = parts - 1;
+  for (size_t i = 1; i < parts; i++) {
+    env_->StartThread(&DBImpl::BGSubcompaction, &jobs[i]);
+  }
+  jobs[0].status = DoCompactionRange(jobs[0].state);
+  mu.Lock();
+  while (running > 0) {
+    cv.Wait();
+  }
+  mu.Unlock();
+
+  // The parts cover increasing key ranges, so their outputs are already
+  // in order.  Outputs of failed parts are kept so that CleanupCompaction()
+  // releases their file numbers.
+  Status status;
+  for (size_t i = 0; i < parts; i++) {
+    CompactionState* sub = jobs[i].state;
+    if (status.ok()) {
+      status = jobs[i].status;
+    }
+    if (sub->builder != NULL) {
+      sub->builder->Abandon();
+      delete sub->builder;
+    }
+    delete sub->outfile;
+    compact->outputs.insert(compact->outputs.end(),
+                            sub->outputs.begin(), sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    compact->imm_micros += sub->imm_micros;
+    delete sub;
+  }
+  return status;
+}
+
+void DBImpl::BGSubcompaction(void* arg) {
+  SubcompactionJob* job = reinterpret_cast<SubcompactionJob*>(arg);
+  job->status = job->db->DoCompactionRange(job->state);
+  job->mu->Lock();
+  (*job->running)--;
+  job->cv->Signal();
+  job->mu->Unlock();
+}
+
+void DBImpl::MaybeCompactMemTable(int64_t* imm_micros) {
+  if (has_imm_.NoBarrier_Load() == NULL ||
+      imm_compacting_.Acquire_Load() != NULL) {
+    return;
+  }
+  const uint64_t imm_start = env_->NowMicros();
+  mutex_.Lock();
+  // CompactMemTable() releases mutex_ while writing the table, so make
+  // sure other parts of a split compaction do not flush imm_ as well.
+  if (imm_ != NULL && imm_compacting_.NoBarrier_Load() == NULL) {
+    imm_compacting_.Release_Store(this);
+    CompactMemTable();
+    imm_compacting_.Release_Store(NULL);
+    bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+  }
+  mutex_.Unlock();
+  *imm_micros += (env_->NowMicros() - imm_start);
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact) {
+  const Comparator* ucmp = user_comparator();
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
+  if (compact->has_begin) {
+    // Entries for the begin key itself belong to the previous part
+    InternalKey begin(compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(begin.Encode());
+    while (input->Valid() &&
+           (input->key().size() < 8 ||
+            ucmp->Compare(ExtractUserKey(input->key()),
+                          Slice(compact->begin)) <= 0)) {
+      input->Next();
+    }
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
@@ -883,19 +1207,14 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // Prioritize immutable compaction work
-    if (has_imm_.NoBarrier_Load() != NULL) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != NULL) {
-        CompactMemTable();
-        bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
-      }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
-    }
+    MaybeCompactMemTable(&compact->imm_micros);
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_end && key.size() >= 8 &&
+        ucmp->Compare(ExtractUserKey(key), Slice(compact->end)) > 0) {
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != NULL) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
@@ -912,8 +1231,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key,
-                                     Slice(current_user_key)) != 0) {
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
@@ -925,7 +1243,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;    // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -944,7 +1263,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -985,31 +1305,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     status = input->status();
   }
   delete input;
-  input = NULL;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1295,7 +1590,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       break;
     } else if (
         allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
+        versions_->NumLevelFiles(0) >= options_.l0_slowdown_writes_trigger) {
       // We are getting close to hitting a hard limit on the number of
       // L0 files.  Rather than delaying a single write by several
       // seconds when we hit the hard limit, start delaying each
@@ -1303,9 +1598,12 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // this delay hands over some CPU to the compaction thread in
       // case it is sharing the same core as the writer.
       mutex_.Unlock();
+      const uint64_t start = env_->NowMicros();
       env_->SleepForMicroseconds(1000);
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
+      stall_stats_.slowdowns++;
+      stall_stats_.micros += env_->NowMicros() - start;
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1314,11 +1612,17 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      stall_stats_.memtable_waits++;
+      stall_stats_.micros += env_->NowMicros() - start;
+    } else if (versions_->NumLevelFiles(0) >= options_.l0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
+      stall_stats_.level0_waits++;
+      stall_stats_.micros += env_->NowMicros() - start;
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1395,6 +1699,27 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "write-stalls") {
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%lld %lld %lld %lld",
+             static_cast<long long>(stall_stats_.slowdowns),
+             static_cast<long long>(stall_stats_.memtable_waits),
+             static_cast<long long>(stall_stats_.level0_waits),
+             static_cast<long long>(stall_stats_.micros));
+    *value = buf;
+    return true;
+  } else if (in == "compaction-totals") {
+    CompactionStats total;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      total.Add(stats_[level]);
+    }
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%lld %lld %lld",
+             static_cast<long long>(total.micros),
+             static_cast<long long>(total.bytes_read),
+             static_cast<long long>(total.bytes_written));
+    *value = buf;
+    return true;
   }
 
   return false;
@@ -1440,6 +1765,10 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::BulkLoad(Iterator* source) {
+  return Status::NotSupported("BulkLoad");
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
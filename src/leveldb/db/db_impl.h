@@ -7,6 +7,7 @@
 
 #include <deque>
 #include <set>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
@@ -18,10 +19,12 @@
 namespace leveldb {
 
 class MemTable;
+class TableBuilder;
 class TableCache;
 class Version;
 class VersionEdit;
 class VersionSet;
+struct FileMetaData;
 
 class DBImpl : public DB {
  public:
@@ -41,6 +44,7 @@ class DBImpl : public DB {
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status BulkLoad(Iterator* source);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -67,6 +71,7 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionJob;
   struct Writer;
 
   Iterator* NewInternalIterator(const ReadOptions&,
@@ -113,11 +118,26 @@ class DBImpl : public DB {
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Merge the part of the compaction's inputs covered by *compact into
+  // new output files.  Called without mutex_ held, possibly from several
+  // threads at once for disjoint parts of the same compaction.
+  Status DoCompactionRange(CompactionState* compact);
+  Status DoSubcompactions(CompactionState* compact,
+                          const std::vector<std::string>& split_keys);
+  static void BGSubcompaction(void* job);
+
+  // Flush imm_ if it is full and no other thread is already doing so.
+  // Adds the time spent to *imm_micros.
+  void MaybeCompactMemTable(int64_t* imm_micros);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  Status FinishBulkLoadTable(TableBuilder* builder, WritableFile* file,
+                             FileMetaData* meta);
+
   // Constant after construction
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
@@ -140,6 +160,7 @@ class DBImpl : public DB {
   MemTable* mem_;
   MemTable* imm_;                // Memtable being compacted
   port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  port::AtomicPointer imm_compacting_;  // Some thread is flushing imm_
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
@@ -158,6 +179,10 @@ class DBImpl : public DB {
   // Has a background compaction been scheduled or is running?
   bool bg_compaction_scheduled_;
 
+  // Is BulkLoad() installing its tables?  No compactions are scheduled
+  // meanwhile, since only one thread may call LogAndApply() at a time.
+  bool bulk_load_installing_;
+
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
@@ -190,6 +215,18 @@ class DBImpl : public DB {
   };
   CompactionStats stats_[config::kNumLevels];
 
+  // Writes held back by MakeRoomForWrite(), and the total time spent there.
+  struct WriteStallStats {
+    int64_t slowdowns;       // writes delayed 1ms for too many level-0 files
+    int64_t memtable_waits;  // waits for the previous memtable to be compacted
+    int64_t level0_waits;    // waits for level-0 to drop below the stop trigger
+    int64_t micros;
+
+    WriteStallStats()
+        : slowdowns(0), memtable_waits(0), level0_waits(0), micros(0) { }
+  };
+  WriteStallStats stall_stats_;
+
   // No copying allowed
   DBImpl(const DBImpl&);
   void operator=(const DBImpl&);
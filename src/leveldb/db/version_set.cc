@@ -1034,7 +1034,7 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-          static_cast<double>(config::kL0_CompactionTrigger);
+          static_cast<double>(options_->l0_compaction_trigger);
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
@@ -1396,16 +1396,19 @@ Compaction* VersionSet::CompactRange(
   return c;
 }
 
+Compaction::Cursor::Cursor()
+    : grandparent_index(0),
+      seen_key(false),
+      overlapped_bytes(0) {
+  for (int i = 0; i < config::kNumLevels; i++) {
+    level_ptrs[i] = 0;
+  }
+}
+
 Compaction::Compaction(int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(level)),
-      input_version_(NULL),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
-  }
+      input_version_(NULL) {
 }
 
 Compaction::~Compaction() {
@@ -1431,13 +1434,77 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+namespace {
+struct SplitCandidate {
+  Slice user_key;
+  uint64_t file_size;
+};
+
+struct SplitCandidateOrder {
+  const Comparator* user_cmp;
+  bool operator()(const SplitCandidate& a, const SplitCandidate& b) const {
+    return user_cmp->Compare(a.user_key, b.user_key) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetSplitKeys(int max_parts,
+                              std::vector<std::string>* split_keys) const {
+  split_keys->clear();
+
+  // Every input file ends at a user key where the merged output can be
+  // cut; weight each such key by the size of the file that ends there.
+  std::vector<SplitCandidate> candidates;
+  uint64_t total_size = 0;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      SplitCandidate c;
+      c.user_key = inputs_[which][i]->largest.user_key();
+      c.file_size = inputs_[which][i]->file_size;
+      candidates.push_back(c);
+      total_size += c.file_size;
+    }
+  }
+
+  // Splitting only pays off if every part still fills an output file.
+  const int64_t parts = std::min<int64_t>(
+      max_parts, total_size / std::max<uint64_t>(max_output_file_size_, 1));
+  if (parts < 2) {
+    return;
+  }
+
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  SplitCandidateOrder order;
+  order.user_cmp = user_cmp;
+  std::sort(candidates.begin(), candidates.end(), order);
+
+  // The largest key ends the last part, so it never becomes a split key.
+  uint64_t seen_size = 0;
+  for (size_t i = 0; i + 1 < candidates.size() &&
+           split_keys->size() + 1 < static_cast<size_t>(parts); i++) {
+    seen_size += candidates[i].file_size;
+    if (seen_size * parts < total_size * (split_keys->size() + 1)) {
+      continue;
+    }
+    if (user_cmp->Compare(candidates[i].user_key,
+                          candidates.back().user_key) >= 0) {
+      break;
+    }
+    if (split_keys->empty() ||
+        user_cmp->Compare(candidates[i].user_key,
+                          Slice(split_keys->back())) > 0) {
+      split_keys->push_back(candidates[i].user_key.ToString());
+    }
+  }
+}
+
+bool Compaction::IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; cursor->level_ptrs[lvl] < files.size(); ) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1446,28 +1513,29 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key, Cursor* cursor) {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
       icmp->Compare(internal_key,
-                    grandparents_[grandparent_index_]->largest.Encode()) > 0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                    grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > kMaxGrandParentOverlapBytes) {
+  if (cursor->overlapped_bytes > kMaxGrandParentOverlapBytes) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
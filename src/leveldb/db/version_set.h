@@ -347,14 +347,40 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of one pass over the inputs in key order, as needed by
+  // IsBaseLevelForKey() and ShouldStopBefore().  Both only move forward,
+  // so each thread merging part of the inputs needs a cursor of its own.
+  struct Cursor {
+    // Index in grandparents_ and bytes of overlap between the current
+    // output and grandparent files, for ShouldStopBefore()
+    size_t grandparent_index;
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+
+    Cursor();
+  };
+
+  // Fill *split_keys with up to max_parts-1 increasing user keys that cut
+  // the inputs into parts of roughly equal size.  Each part covers the
+  // user keys after the previous split key up to and including its own.
+  // Leaves *split_keys empty if the inputs are too small to be worth
+  // splitting.
+  void GetSplitKeys(int max_parts, std::vector<std::string>* split_keys) const;
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor);
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor);
 
   // Release the input version for the compaction, once the compaction
   // is successful.
@@ -377,18 +403,6 @@ class Compaction {
   // State used to check for number of of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
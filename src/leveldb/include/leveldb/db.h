@@ -116,6 +116,11 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.write-stalls" - returns "<slowdowns> <memtable waits>
+  //     <level-0 waits> <micros>": how often writes were delayed or blocked
+  //     waiting for compactions, and the total time spent doing so.
+  //  "leveldb.compaction-totals" - returns "<micros> <bytes read>
+  //     <bytes written>" summed over all compactions.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -141,6 +146,22 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Add the entries produced by "source" straight to new table files in
+  // the last level, bypassing the log, the memtable and compactions.
+  // "source" must yield keys in increasing order without duplicates; it
+  // is scanned once, forward from SeekToFirst().
+  //
+  // The entries count as older than everything already in the database,
+  // so a key that was written before the call keeps its current value.
+  // A deletion does not reliably hide an entry loaded after it: once a
+  // compaction has dropped its tombstone, the loaded entry shows through.
+  // This is meant for filling a key range that holds no keys and no
+  // deletions, much faster than writing it.
+  //
+  // Returns NotSupported if files in the last level overlap the key
+  // range of "source"; nothing is added in that case.
+  virtual Status BulkLoad(Iterator* source);
+
  private:
   // No copying allowed
   DB(const DB&);
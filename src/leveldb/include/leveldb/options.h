@@ -135,6 +135,24 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // Number of level-0 files at which a compaction of level-0 is started,
+  // at which writes are slowed down (by delaying each write by 1ms), and
+  // at which writes stop until a compaction finishes.  Raising the last
+  // two lets bursts of writes (bulk loads, index building) proceed while
+  // compactions catch up, at the cost of more files to check on reads.
+  //
+  // Default: 4, 8 and 12
+  int l0_compaction_trigger;
+  int l0_slowdown_writes_trigger;
+  int l0_stop_writes_trigger;
+
+  // Maximum number of threads a single compaction is split across.  Each
+  // thread merges a disjoint key range of the compaction's inputs into
+  // its own output files, so large level-0 compactions finish sooner.
+  //
+  // Default: 1
+  int max_subcompactions;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -5,6 +5,8 @@
 
 #include "leveldb/options.h"
 
+#include "db/dbformat.h"
+
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 
@@ -23,7 +25,11 @@ Options::Options()
       block_size(4096),
       block_restart_interval(16),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      l0_compaction_trigger(config::kL0_CompactionTrigger),
+      l0_slowdown_writes_trigger(config::kL0_SlowdownWritesTrigger),
+      l0_stop_writes_trigger(config::kL0_StopWritesTrigger),
+      max_subcompactions(1) {
 }
 
 
@@ -12,6 +12,8 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
+#include "blockstore.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -101,7 +103,7 @@ CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 CTxMemPool mempool(::minRelayTxFee);
 
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
 };
 map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);;
@@ -214,9 +216,13 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //! Set while the block is being rebuilt from a cmpctblock.
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+    /** Peers we asked to announce new blocks to us as cmpctblock, oldest first. Protected by cs_main. */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
     /** Number of blocks in flight with validated headers. */
     int nQueuedValidatedHeaders = 0;
 
@@ -346,6 +352,7 @@ void FinalizeNode(NodeId nodeid) {
 
     BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
@@ -370,20 +377,73 @@ bool MarkBlockAsReceived(const uint256& hash) {
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
+// Returns false if the block was already in flight from this same peer, in
+// which case the existing request is left alone. Either way pit, if given,
+// is set to the peer's entry for the block.
+bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL, list<QueuedBlock>::iterator *pit = NULL) {
     CNodeState *state = State(nodeid);
     assert(state != NULL);
 
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid) {
+        if (pit)
+            *pit = itInFlight->second.second;
+        return false;
+    }
+
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
     int64_t nNow = GetTimeMicros();
-    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams)};
+    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams), std::shared_ptr<PartiallyDownloadedBlock>()};
     nQueuedValidatedHeaders += newentry.fValidatedHeaders;
     list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    if (pit)
+        *pit = it;
+    return true;
+}
+
+// Requires cs_main.
+// Whether our tip is recent enough that fetching announced blocks directly
+// (rather than through the parallel download logic) makes sense.
+bool CanDirectFetch(const Consensus::Params& consensusParams)
+{
+    return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - consensusParams.nPowTargetSpacing * 20;
+}
+
+// Requires cs_main.
+// Ask pfrom to announce new blocks to us as cmpctblock, keeping at most
+// MAX_HB_CMPCTBLOCK_PEERS such peers, preferring the ones that most recently
+// gave us a new tip.
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom)
+{
+    if (!pfrom->fSupportsCompactBlocks)
+        return;
+    NodeId nodeid = pfrom->GetId();
+    for (list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_HB_CMPCTBLOCK_PEERS) {
+        // As per BIP 152, only a few peers may announce to us in high-bandwidth mode
+        NodeId nodeidEvict = lNodesAnnouncingHeaderAndIDs.front();
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == nodeidEvict) {
+                pnode->PushMessage("sendcmpct", false, CMPCTBLOCKS_VERSION);
+                break;
+            }
+        }
+    }
+    pfrom->PushMessage("sendcmpct", true, CMPCTBLOCKS_VERSION);
+    lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
 }
 
 /** Check whether the last unknown block a peer advertized is not yet known. */
@@ -584,8 +644,9 @@ CSporkDB* pSporkDB = NULL;
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const CTransactionRef& ptx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    const CTransaction& tx = *ptx;
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
@@ -604,7 +665,7 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
+    mapOrphanTransactions[hash].tx = ptx;
     mapOrphanTransactions[hash].fromPeer = peer;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
@@ -619,7 +680,7 @@ void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
+    BOOST_FOREACH(const CTxIn& txin, it->second.tx->vin)
     {
         map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
         if (itPrev == mapOrphanTransactionsByPrev.end())
@@ -640,7 +701,7 @@ void EraseOrphansFor(NodeId peer)
         map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer)
         {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
+            EraseOrphanTx(maybeErase->second.tx->GetHash());
             ++nErased;
         }
     }
@@ -1102,6 +1163,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
     if (nResult < 0) nResult = 0;
 
     if (nResult < 6) {
+        LOCK(cs_swifttx);
         std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
         if (i != mapTxLocks.end()) {
             sigs = (*i).second.CountSignatures();
@@ -1118,9 +1180,12 @@ int GetIXConfirmations(uint256 nTXHash)
 {
     int sigs = 0;
 
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()) {
-        sigs = (*i).second.CountSignatures();
+    {
+        LOCK(cs_swifttx);
+        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
+        if (i != mapTxLocks.end()) {
+            sigs = (*i).second.CountSignatures();
+        }
     }
     if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
         return nSwiftTXDepth;
@@ -1415,10 +1480,24 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee, bool ignoreFees)
+/** Trim the pool to -maxmempool */
+static void LimitMempoolSize(CTxMemPool& pool)
+{
+    pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+}
+
+/**
+ * nCheckedHeight is the next block height for which the caller already ran
+ * CheckTransaction and ContextualCheckTransaction on the transaction, or -1.
+ * Those checks verify the shielded proofs and signatures, which needs no
+ * chain state, so callers can run them without cs_main.
+ */
+static bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                                     bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectAbsurdFee, bool ignoreFees,
+                                     bool fOverrideMempoolLimit, int nCheckedHeight)
 {
     AssertLockHeld(cs_main);
+    const CTransaction& tx = *ptx;
     if (pfMissingInputs)
         *pfMissingInputs = false;
 
@@ -1439,14 +1518,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
     }
 
-    auto verifier = libzcash::ProofVerifier::Strict();
-    if (!CheckTransaction(tx, state, verifier))
-        return error("AcceptToMemoryPool: CheckTransaction failed");
+    if (nCheckedHeight != nextBlockHeight) {
+        auto verifier = libzcash::ProofVerifier::Strict();
+        if (!CheckTransaction(tx, state, verifier))
+            return error("AcceptToMemoryPool: CheckTransaction failed");
 
-    // DoS level set to 10 to be more forgiving.
-    // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
-    if (!ContextualCheckTransaction(tx, state, nextBlockHeight, 10)) {
-        return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
+        // DoS level set to 10 to be more forgiving.
+        // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
+        if (!ContextualCheckTransaction(tx, state, nextBlockHeight, 10)) {
+            return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
+        }
     }
 
     // DoS mitigation: reject transactions expiring soon
@@ -1586,7 +1667,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         // it has passed ContextualCheckInputs and therefore this is correct.
         auto consensusBranchId = CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx), fSpendsCoinbase, consensusBranchId);
+        CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx), fSpendsCoinbase, consensusBranchId);
         unsigned int nSize = entry.GetTxSize();
 
         // Accept a tx if it contains joinsplits and has at least the default fee specified by z_sendmany.
@@ -1614,6 +1695,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                                 REJECT_INSUFFICIENTFEE, "insufficient fee");
         }
 
+        // Once the pool has been trimmed, a transaction has to beat the fee
+        // rate of what was evicted until the rolling minimum fee decays
+        if (!fOverrideMempoolLimit && !ignoreFees) {
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+                return state.DoS(0, error("AcceptToMemoryPool: mempool min fee not met %s, %d < %d",
+                                        hash.ToString(), nFees, mempoolRejectFee),
+                                REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+        }
+
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
@@ -1685,6 +1776,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         if (fSpentIndex) {
             pool.addSpentIndex(entry, view);
         }
+
+        // Trim the pool and check whether tx was trimmed
+        if (!fOverrideMempoolLimit) {
+            LimitMempoolSize(pool);
+            if (!pool.exists(hash))
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
 
     SyncWithWallets(tx, NULL);
@@ -1692,11 +1790,218 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return true;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fRejectAbsurdFee, bool ignoreFees, bool fOverrideMempoolLimit)
+{
+    return AcceptToMemoryPoolWorker(pool, state, ptx, fLimitFree, pfMissingInputs, GetTime(), fRejectAbsurdFee, ignoreFees,
+                                    fOverrideMempoolLimit, -1);
+}
+
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fRejectAbsurdFee, bool ignoreFees, bool fOverrideMempoolLimit)
+{
+    return AcceptToMemoryPool(pool, state, MakeTransactionRef(tx), fLimitFree, pfMissingInputs, fRejectAbsurdFee, ignoreFees, fOverrideMempoolLimit);
+}
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Transactions LoadMempool adds to the pool per cs_main section
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+/**
+ * The chain-independent checks of AcceptToMemoryPool on every transaction
+ * read from mempool.dat, run by one set of threads for the whole load.
+ */
+class CMempoolLoadChecks
+{
+private:
+    const std::vector<std::pair<CTransactionRef, int64_t> >& vTx;
+    const int nHeight;
+    std::atomic<size_t> nNext;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<char> vDone;
+    std::vector<char> vChecked;
+
+public:
+    CMempoolLoadChecks(const std::vector<std::pair<CTransactionRef, int64_t> >& vTxIn, int nHeightIn) :
+        vTx(vTxIn), nHeight(nHeightIn), nNext(0), vDone(vTxIn.size(), false), vChecked(vTxIn.size(), false) {}
+
+    //! Check the next transaction no thread has taken yet; false once there are none left
+    bool CheckNext()
+    {
+        size_t i = nNext++;
+        if (i >= vTx.size())
+            return false;
+        CValidationState state;
+        auto verifier = libzcash::ProofVerifier::Strict();
+        bool fValid = CheckTransaction(*vTx[i].first, state, verifier) && ContextualCheckTransaction(*vTx[i].first, state, nHeight, 10);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        vChecked[i] = fValid;
+        vDone[i] = true;
+        cond.notify_all();
+        return true;
+    }
+
+    //! Worker thread body
+    void Loop()
+    {
+        while (CheckNext()) {}
+    }
+
+    //! Whether transaction i passed, helping with the checks until it is done
+    bool Wait(size_t i)
+    {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (vDone[i])
+                    return vChecked[i];
+            }
+            if (!CheckNext())
+                break;
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!vDone[i])
+            cond.wait(lock);
+        return vChecked[i];
+    }
+
+    //! Leave the transactions no thread has taken yet unchecked
+    void Stop() { nNext = vTx.size(); }
+};
+
+bool LoadMempool()
+{
+    int64_t nStart = GetTimeMillis();
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    std::vector<std::pair<CTransactionRef, int64_t> > vTx;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION)
+            return false;
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            CTransactionRef tx;
+            int64_t nTime;
+            file >> tx;
+            file >> nTime;
+            vTx.push_back(std::make_pair(tx, nTime));
+        }
+        file >> mapDeltas;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); ++it)
+        mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+
+    // Proofs and signatures are verified by the worker threads with
+    // cs_main released, while this thread adds the transactions already
+    // checked in order, taking cs_main once per batch. The dump lists
+    // parents first, so a parent is always added before its children.
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height() + 1;
+    }
+    CMempoolLoadChecks checks(vTx, nHeight);
+    boost::thread_group workers;
+    for (int i = 1; i < nScriptCheckThreads; i++)
+        workers.create_thread(boost::bind(&CMempoolLoadChecks::Loop, &checks));
+    // The workers use this frame, so it must not be left by an interruption
+    boost::this_thread::disable_interruption di;
+
+    int count = 0, failed = 0, already_there = 0;
+    for (size_t nBegin = 0; nBegin < vTx.size() && !ShutdownRequested(); nBegin += MEMPOOL_LOAD_BATCH_SIZE) {
+        size_t nEnd = std::min(nBegin + MEMPOOL_LOAD_BATCH_SIZE, vTx.size());
+        std::vector<char> vChecked;
+        for (size_t i = nBegin; i < nEnd; i++)
+            vChecked.push_back(checks.Wait(i));
+
+        LOCK(cs_main);
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const CTransactionRef& ptx = vTx[i].first;
+            CValidationState state;
+            // A block connected since the checks makes the worker check again
+            if (vChecked[i - nBegin] && AcceptToMemoryPoolWorker(mempool, state, ptx, true, NULL, vTx[i].second,
+                                                                 false, false, false, nHeight)) {
+                ++count;
+            } else if (mempool.exists(ptx->GetHash())) {
+                ++already_there;
+            } else {
+                ++failed;
+            }
+        }
+    }
+
+    checks.Stop();
+    workers.join_all();
+    if (ShutdownRequested())
+        return false;
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i already there, in %dms\n",
+              count, failed, already_there, GetTimeMillis() - nStart);
+    return true;
+}
+
+void DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::vector<CTxMemPoolEntry> vEntries;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    {
+        LOCK(mempool.cs);
+        mempool.queryEntries(vEntries);
+        mapDeltas.insert(mempool.mapDeltas.begin(), mempool.mapDeltas.end());
+    }
+
+    int64_t nMid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr)
+            return;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+
+        file << (uint64_t)vEntries.size();
+        BOOST_FOREACH(const CTxMemPoolEntry& entry, vEntries) {
+            file << entry.GetTx();
+            file << entry.GetTime();
+        }
+        file << mapDeltas;
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        int64_t nLast = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (nMid - nStart) * 0.000001, (nLast - nMid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+    }
+}
+
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
 {
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
+    if (pblocktree->IsBulkLoading())
+        return error("Timestamp index is being rebuilt");
 
     if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
@@ -1712,6 +2017,9 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
+    if (pblocktree->IsBulkLoading())
+        return false;
+
     if (!pblocktree->ReadSpentIndex(key, value))
         return false;
 
@@ -1723,6 +2031,8 @@ bool GetAddressIndex(uint160 addressHash, int type,
 {
     if (!fAddressIndex)
         return error("address index not enabled");
+    if (pblocktree->IsBulkLoading())
+        return error("address index is being rebuilt");
 
     if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
@@ -1735,6 +2045,8 @@ bool GetAddressUnspent(uint160 addressHash, int type,
 {
     if (!fAddressIndex)
         return error("address index not enabled");
+    if (pblocktree->IsBulkLoading())
+        return error("address index is being rebuilt");
 
     if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
@@ -1772,14 +2084,11 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
     // ----------- instantX transaction scanning -----------
 
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                return state.DoS(0,
-                                 error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                                 REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 hashLock;
+    if (GetConflictingLock(tx, hashLock)) {
+        return state.DoS(0,
+                         error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+                         REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1953,16 +2262,28 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
             CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            CMappedBlock mapped;
+            if (blockfilemap.Find(postx, Params().MessageStart(), mapped)) {
+                try {
+                    CMemoryReader file(mapped.pbegin, mapped.pend, SER_DISK, CLIENT_VERSION);
+                    file >> header;
+                    file.ignore(postx.nTxOffset);
+                    file >> txOut;
+                } catch (const std::exception& e) {
+                    return error("%s: Deserialize error - %s", __func__, e.what());
+                }
+            } else {
+                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                if (file.IsNull())
+                    return error("%s: OpenBlockFile failed", __func__);
+                try {
+                    file >> header;
+                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                    file >> txOut;
+                } catch (const std::exception& e) {
+                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                }
             }
             hashBlock = header.GetHash();
             if (txOut.GetHash() != hash)
@@ -1984,11 +2305,11 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
     }
 
     if (pindexSlow) {
-        CBlock block;
-        if (ReadBlockFromDisk(block, pindexSlow)) {
-            BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-                if (tx.GetHash() == hash) {
-                    txOut = tx;
+        std::shared_ptr<const CBlock> pblock;
+        if (ReadBlockFromDisk(pblock, pindexSlow)) {
+            BOOST_FOREACH(const CTransactionRef& ptx, pblock->vtx) {
+                if (ptx->GetHash() == hash) {
+                    txOut = *ptx;
                     hashBlock = pindexSlow->GetBlockHash();
                     return true;
                 }
@@ -2034,14 +2355,19 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
     // Read block
     try {
-        filein >> block;
+        CMappedBlock mapped;
+        if (blockfilemap.Find(pos, Params().MessageStart(), mapped)) {
+            CMemoryReader filein(mapped.pbegin, mapped.pend, SER_DISK, CLIENT_VERSION);
+            filein >> block;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -2057,6 +2383,12 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
+    // A cached copy saves parsing the block and checking its solution again
+    std::shared_ptr<const CBlock> pblock = blockcache.Get(pindex->GetBlockHash());
+    if (pblock) {
+        block = *pblock;
+        return true;
+    }
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
@@ -2065,6 +2397,79 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
+{
+    pblock = blockcache.Get(pindex->GetBlockHash());
+    if (pblock)
+        return true;
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblockRead, pindex))
+        return false;
+    pblock = pblockRead;
+    blockcache.Insert(pindex->GetBlockHash(), pblock);
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    ssBlock.clear();
+
+    // The index header (message start and size) precedes the block itself
+    CDiskBlockPos hpos = pos;
+    if (hpos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("ReadRawBlockFromDisk: invalid block position %s", pos.ToString());
+    hpos.nPos -= MESSAGE_START_SIZE + sizeof(unsigned int);
+
+    CMappedBlock mapped;
+    if (blockfilemap.Find(pos, messageStart, mapped)) {
+        ssBlock.write(mapped.pbegin, mapped.pend - mapped.pbegin);
+        return true;
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    // Read the serialized block in one go, without deserializing it
+    try {
+        CMessageHeader::MessageStartChars blkStart;
+        unsigned int nSize;
+        filein >> FLATDATA(blkStart) >> nSize;
+        if (memcmp(blkStart, messageStart, MESSAGE_START_SIZE))
+            return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+        if (nSize > MAX_BLOCK_SIZE_AFTER_UPGRADE)
+            return error("%s: Block size %u too large at %s", __func__, nSize, pos.ToString());
+        ssBlock.resize(nSize);
+        filein.read(&ssBlock[0], nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!ReadRawBlockFromDisk(ssBlock, pindex->GetBlockPos(), messageStart))
+        return false;
+
+    // Only the header is parsed, to make sure the bytes belong to this block
+    try {
+        CBlockHeader header;
+        ssBlock >> header;
+        ssBlock.Rewind(::GetSerializeSize(header, SER_NETWORK, PROTOCOL_VERSION));
+        if (header.GetHash() != pindex->GetBlockHash())
+            return error("ReadRawBlockFromDisk(CDataStream&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                    pindex->ToString(), pindex->GetBlockPos().ToString());
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+    }
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     CAmount nSubsidy;
@@ -2500,6 +2905,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -2527,6 +2934,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -2605,7 +3014,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
         uint256 hash = tx.GetHash();
 
         if (fAddressIndex) {
@@ -2884,8 +3293,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
-    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
-        const CCoins* coins = view.AccessCoins(tx.GetHash());
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+        const CCoins* coins = view.AccessCoins(ptx->GetHash());
         if (coins && !coins->IsPruned())
             return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
                              REJECT_INVALID, "bad-txns-BIP30");
@@ -2939,7 +3348,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
         const uint256 txhash = tx.GetHash();
 
         nInputs += tx.vin.size();
@@ -3092,7 +3501,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if(!IsBlockValueValid(block, blockReward))
         return state.DoS(100,
                          error("ConnectBlock(): coinbase pays too much (actual=%d vs limit=%d)",
-                               block.vtx[0].GetValueOut(), blockReward),
+                               block.vtx[0]->GetValueOut(), blockReward),
                                REJECT_INVALID, "bad-cb-amount");
 
     if (!control.Wait())
@@ -3181,7 +3590,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
     GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
-    hashPrevBestCoinBase = block.vtx[0].GetHash();
+    hashPrevBestCoinBase = block.vtx[0]->GetHash();
 
     int64_t nTime4 = GetTimeMicros(); nTimeCallbacks += nTime4 - nTime3;
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
@@ -3379,12 +3788,12 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
 
     if (!fBare) {
         // Resurrect mempool transactions from the disconnected block.
-        BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
             // ignore validation errors in resurrected transactions
             list<CTransaction> removed;
             CValidationState stateDummy;
-            if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
-                mempool.remove(tx, removed, true);
+            if (ptx->IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, ptx, false, NULL, false, false, true))
+                mempool.remove(*ptx, removed, true);
         }
         if (sproutAnchorBeforeDisconnect != sproutAnchorAfterDisconnect) {
             // The anchor may not change between block disconnects,
@@ -3407,8 +3816,8 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
     assert(pcoinsTip->GetSaplingAnchorAt(pcoinsTip->GetBestAnchor(SAPLING), newSaplingTree));
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-        SyncWithWallets(tx, NULL);
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+        SyncWithWallets(*ptx, NULL);
     }
     // Update cached incremental witnesses
     GetMainSignals().ChainTip(pindexDelete, &block, newSproutTree, newSaplingTree, false);
@@ -3481,8 +3890,8 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
         SyncWithWallets(tx, NULL);
     }
     // ... and about transactions that got confirmed:
-    BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
-        SyncWithWallets(tx, pblock);
+    BOOST_FOREACH(const CTransactionRef& ptx, pblock->vtx) {
+        SyncWithWallets(*ptx, pblock);
     }
     // Update cached incremental witnesses
     GetMainSignals().ChainTip(pindexNew, pblock, oldSproutTree, oldSaplingTree, true);
@@ -3504,6 +3913,7 @@ bool DisconnectBlocksAndReprocess(int blocks)
     LogPrintf("DisconnectBlocksAndReprocess: Got command to replay %d blocks\n", blocks);
     for (int i = 0; i <= blocks; i++)
         DisconnectTip(state);
+    LimitMempoolSize(mempool);
 
     return true;
 }
@@ -3707,6 +4117,8 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
 
     if (fBlocksDisconnected) {
         mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+        // Transactions from the disconnected blocks went in over the limit
+        LimitMempoolSize(mempool);
     }
     mempool.removeWithoutBranchId(
         CurrentEpochBranchId(chainActive.Tip()->nHeight + 1, Params().GetConsensus()));
@@ -3758,10 +4170,26 @@ bool ActivateBestChain(CValidationState &state, CBlock *pblock) {
             if (fCheckpointsEnabled)
                 nBlockEstimate = Checkpoints::GetTotalBlocksEstimate(chainParams.Checkpoints());
             {
+                // Peers that asked for high-bandwidth compact block relay get
+                // the block itself, as a cmpctblock, without waiting for a getdata.
+                // That's only possible when the new tip is the block we were handed.
+                boost::scoped_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+                if (pblock && pblock->GetHash() == hashNewTip)
+                    pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
+                CInv inv(MSG_BLOCK, hashNewTip);
                 LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                BOOST_FOREACH(CNode* pnode, vNodes) {
+                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate)) {
+                        if (pcmpctblock && pnode->fPreferHeaderAndIDs) {
+                            LOCK(pnode->cs_inventory);
+                            if (!pnode->setInventoryKnown.count(inv)) {
+                                pnode->PushMessage("cmpctblock", *pcmpctblock);
+                                pnode->setInventoryKnown.insert(inv);
+                            }
+                        }
+                        pnode->PushInventory(inv);
+                    }
+                }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -3795,6 +4223,7 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
         // unconditionally valid already, so force disconnect away from it.
         if (!DisconnectTip(state)) {
             mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+            LimitMempoolSize(mempool);
             mempool.removeWithoutBranchId(
                 CurrentEpochBranchId(chainActive.Tip()->nHeight + 1, Params().GetConsensus()));
             return false;
@@ -3813,6 +4242,8 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
 
     InvalidChainFound(pindex);
     mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+    // Transactions from the disconnected blocks went in over the limit
+    LimitMempoolSize(mempool);
     mempool.removeWithoutBranchId(
         CurrentEpochBranchId(chainActive.Tip()->nHeight + 1, Params().GetConsensus()));
     return true;
@@ -3892,7 +4323,8 @@ bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBl
     pindexNew->nChainTx = 0;
     CAmount sproutValue = 0;
     CAmount saplingValue = 0;
-    for (auto tx : block.vtx) {
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         // Negative valueBalance "takes" money from the transparent value pool
         // and adds it to the Sapling value pool. Positive valueBalance "gives"
         // money to the transparent value pool, removing from the Sapling value
@@ -4128,29 +4560,25 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
                          REJECT_INVALID, "bad-blk-length");
 
     // First transaction must be coinbase, the rest must not be
-    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
+    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase())
         return state.DoS(100, error("CheckBlock(): first tx is not coinbase"),
                          REJECT_INVALID, "bad-cb-missing");
     for (unsigned int i = 1; i < block.vtx.size(); i++)
-        if (block.vtx[i].IsCoinBase())
+        if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, error("CheckBlock(): more than one coinbase"),
                              REJECT_INVALID, "bad-cb-multiple");
 
     // ----------- swiftTX transaction scanning -----------
     if (IsSporkActive(SPORK_3_SWIFTTX_BLOCK_FILTERING)) {
-        BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-            if (!tx.IsCoinBase()) {
-                //only reject blocks when it's based on complete consensus
-                BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                    if (mapLockedInputs.count(in.prevout)) {
-                        if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                            mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
-                            LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString(), tx.GetHash().ToString());
-                            return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
-                                REJECT_INVALID, "conflicting-tx-ix");
-                        }
-                    }
-                }
+        BOOST_FOREACH (const CTransactionRef& ptx, block.vtx) {
+            const CTransaction& tx = *ptx;
+            //only reject blocks when it's based on complete consensus
+            uint256 hashLock;
+            if (!tx.IsCoinBase() && GetConflictingLock(tx, hashLock)) {
+                mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
+                LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", hashLock.ToString(), tx.GetHash().ToString());
+                return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
+                    REJECT_INVALID, "conflicting-tx-ix");
             }
         }
     } else {
@@ -4188,14 +4616,14 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
         }
     }
     // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state, verifier))
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
+        if (!CheckTransaction(*ptx, state, verifier))
             return error("CheckBlock(): CheckTransaction failed");
 
     unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
     {
-        nSigOps += GetLegacySigOpCount(tx);
+        nSigOps += GetLegacySigOpCount(*ptx);
     }
     if (nSigOps > MAX_BLOCK_SIGOPS)
         return state.DoS(100, error("CheckBlock(): out-of-bounds SigOpCount"),
@@ -4257,7 +4685,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
     // Check that all transactions are finalized
-    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx) {
+        const CTransaction& tx = *ptx;
 
         // Check transaction contextually against consensus rules at block height
         if (!ContextualCheckTransaction(tx, state, nHeight, 100)) {
@@ -4280,8 +4709,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     if (nHeight > Params().EnforceBlockUpgradeMajority())
     {
         CScript expect = CScript() << nHeight;
-        if (block.vtx[0].vin[0].scriptSig.size() < expect.size() ||
-            !std::equal(expect.begin(), expect.end(), block.vtx[0].vin[0].scriptSig.begin())) {
+        if (block.vtx[0]->vin[0].scriptSig.size() < expect.size() ||
+            !std::equal(expect.begin(), expect.end(), block.vtx[0]->vin[0].scriptSig.begin())) {
             return state.DoS(100, error("%s: block height mismatch in coinbase", __func__), REJECT_INVALID, "bad-cb-height");
         }
     }
@@ -4290,7 +4719,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
         && nHeight >= (consensusParams.vUpgrades[Consensus::UPGRADE_OVERWINTER].nActivationHeight)) {
         bool found = false;
         
-        BOOST_FOREACH(const CTxOut& output, block.vtx[0].vout) {
+        BOOST_FOREACH(const CTxOut& output, block.vtx[0]->vout) {
             if (output.scriptPubKey == Params().GetVRewardSystemScriptAtHeight(nHeight)) {
                 if (output.nValue == (GetBlockSubsidy(nHeight, consensusParams) * 20 / 100)) {
                     found = true;
@@ -4558,6 +4987,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockfilemap.Unmap(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -5575,15 +6005,21 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         return mapObfuscationBroadcastTxes.count(inv.hash);
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
-    case MSG_TXLOCK_REQUEST:
+    case MSG_TXLOCK_REQUEST: {
+        LOCK(cs_swifttx);
         return mapTxLockReq.count(inv.hash) ||
                mapTxLockReqRejected.count(inv.hash);
-    case MSG_TXLOCK_VOTE:
+    }
+    case MSG_TXLOCK_VOTE: {
+        LOCK(cs_swifttx);
         return mapTxLockVote.count(inv.hash);
-    case MSG_SPORK:
+    }
+    case MSG_SPORK: {
+        LOCK(cs_mapSporks);
         return mapSporks.count(inv.hash);
+    }
     case MSG_MASTERNODE_WINNER:
-        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+        if (masternodePayments.HasPaymentVote(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
             return true;
         }
@@ -5645,7 +6081,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -5670,14 +6106,36 @@ void static ProcessGetData(CNode* pfrom)
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
+                    {
+                        // Send the block bytes exactly as stored on disk;
+                        // the on-disk and network encodings are identical
+                        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+                        if (!ReadRawBlockFromDisk(ssBlock, (*mi).second, Params().MessageStart()))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushMessage("block", ssBlock);
+                    }
+                    else if (inv.type == MSG_CMPCT_BLOCK)
+                    {
+                        std::shared_ptr<const CBlock> pblock;
+                        if (!ReadBlockFromDisk(pblock, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        // Peers close to the tip most likely have the block's
+                        // transactions in their mempool already; anyone
+                        // further behind is better served by the full block.
+                        if (mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                            CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
+                            pfrom->PushMessage("cmpctblock", cmpctblock);
+                        } else
+                            pfrom->PushMessage("block", *pblock);
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        std::shared_ptr<const CBlock> pblock;
+                        if (!ReadBlockFromDisk(pblock, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        const CBlock& block = *pblock;
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
                         {
@@ -5692,7 +6150,7 @@ void static ProcessGetData(CNode* pfrom)
                             typedef std::pair<unsigned int, uint256> PairType;
                             BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
                                 if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                                    pfrom->PushMessage("tx", *block.vtx[pair.first]);
                         }
                         // else
                             // no response
@@ -5714,36 +6172,31 @@ void static ProcessGetData(CNode* pfrom)
             else if (inv.IsKnownType())
             {
                 // Check the mempool to see if a transaction is expiring soon.  If so, do not send to peer.
-                // Note that a transaction enters the mempool first, before the serialized form is cached
-                // in mapRelay after a successful relay.
+                // Note that a transaction enters the mempool first, before it is kept in mapRelay
+                // after a successful relay.
                 bool isExpiringSoon = false;
                 bool pushed = false;
-                CTransaction tx;
-                bool isInMempool = mempool.lookup(inv.hash, tx);
-                if (isInMempool) {
-                    isExpiringSoon = IsExpiringSoonTx(tx, currentHeight + 1);
+                CTransactionRef ptx = mempool.get(inv.hash);
+                if (ptx) {
+                    isExpiringSoon = IsExpiringSoonTx(*ptx, currentHeight + 1);
                 }
 
-                if (!isExpiringSoon) {
-                    // Send stream from relay memory
-                    {
+                if (!isExpiringSoon && inv.type == MSG_TX) {
+                    // Send from relay memory, then from the mempool
+                    if (!ptx) {
                         LOCK(cs_mapRelay);
-                        map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                        if (mi != mapRelay.end()) {
-                            pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                            pushed = true;
-                        }
+                        map<uint256, CTransactionRef>::iterator mi = mapRelay.find(inv.hash);
+                        if (mi != mapRelay.end())
+                            ptx = mi->second;
                     }
-                    if (!pushed && inv.type == MSG_TX) {
-                        if (isInMempool) {
-                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                            ss.reserve(1000);
-                            ss << tx;
-                            pfrom->PushMessage("tx", ss);
-                            pushed = true;
-                        }
-	                }
+                    if (ptx) {
+                        pfrom->PushMessage("tx", *ptx);
+                        pushed = true;
+                    }
+                }
+                if (!isExpiringSoon) {
 	                if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
+	                    LOCK(cs_swifttx);
 	                    if (mapTxLockVote.count(inv.hash)) {
 	                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
 	                        ss.reserve(1000);
@@ -5753,6 +6206,7 @@ void static ProcessGetData(CNode* pfrom)
 	                    }
 	                }
 	                if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
+	                    LOCK(cs_swifttx);
 	                    if (mapTxLockReq.count(inv.hash)) {
 	                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
 	                        ss.reserve(1000);
@@ -5762,6 +6216,7 @@ void static ProcessGetData(CNode* pfrom)
 	                    }
 	                }
 	                if (!pushed && inv.type == MSG_SPORK) {
+	                    LOCK(cs_mapSporks);
 	                    if (mapSporks.count(inv.hash)) {
 	                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
 	                        ss.reserve(1000);
@@ -5771,10 +6226,11 @@ void static ProcessGetData(CNode* pfrom)
 	                    }
 	                }
 	                if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-	                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+	                    CMasternodePaymentWinner winner;
+	                    if (masternodePayments.GetPaymentVote(inv.hash, winner)) {
 	                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
 	                        ss.reserve(1000);
-	                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+	                        ss << winner;
 	                        pfrom->PushMessage("mnw", ss);
 	                        pushed = true;
 	                    }
@@ -5879,6 +6335,58 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/**
+ * Finish rebuilding a block announced through cmpctblock from the missing
+ * transactions the peer sent us (none, if our mempool had all of them) and
+ * hand it to ProcessNewBlock. A failed reconstruction falls back to asking
+ * for the full block.
+ */
+void static ProcessBlockTransactions(CNode* pfrom, const BlockTransactions& resp)
+{
+    CBlock block;
+    {
+        LOCK(cs_main);
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+        if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                it->second.first != pfrom->GetId()) {
+            LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+            return;
+        }
+
+        ReadStatus status = it->second.second->partialBlock->FillBlock(block, resp.txn);
+        if (status == READ_STATUS_INVALID) {
+            MarkBlockAsReceived(resp.blockhash);
+            Misbehaving(pfrom->GetId(), 100);
+            LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+            return;
+        } else if (status == READ_STATUS_FAILED) {
+            // Most likely a short id collision; the block stays in flight
+            // from this peer, just ask for all of it.
+            vector<CInv> vInv(1, CInv(MSG_BLOCK, resp.blockhash));
+            pfrom->PushMessage("getdata", vInv);
+            return;
+        }
+    }
+
+    // We requested this block, so ProcessNewBlock treats it as such and also
+    // drops the partial block along with the in-flight entry.
+    CValidationState state;
+    ProcessNewBlock(state, pfrom, &block, true, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", string("block"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), resp.blockhash);
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    } else {
+        LOCK(cs_main);
+        if (!IsInitialBlockDownload() && chainActive.Tip()->GetBlockHash() == resp.blockhash)
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -6045,6 +6553,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        // Tell the peer we understand compact blocks, without asking it to
+        // announce new blocks to us that way yet. Peers that don't know the
+        // message ignore it.
+        pfrom->PushMessage("sendcmpct", false, CMPCTBLOCKS_VERSION);
+        // Likewise for masternode list snapshots
+        pfrom->PushMessage("sendmnlist", MASTERNODE_LIST_VERSION);
     }
 
 
@@ -6171,9 +6686,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     // not a direct successor.
                     pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
-                    if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
+                    if (CanDirectFetch(chainparams.GetConsensus()) &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // Peers that speak compact blocks can send us just
+                        // the short ids of transactions we probably already have.
+                        if (pfrom->fSupportsCompactBlocks)
+                            vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                        else
+                            vToFetch.push_back(inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -6306,7 +6826,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     else if (strCommand == "tx" || strCommand == "dstx") {
         vector<uint256> vWorkQueue;
         vector<uint256> vEraseQueue;
-        CTransaction tx;
+        CTransactionRef ptx;
 
         //masternode signed transaction
         bool ignoreFees = false;
@@ -6315,10 +6835,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         int64_t sigTime;
 
         if (strCommand == "tx") {
-            vRecv >> tx;
-        } else if (strCommand == "dstx") {
+            vRecv >> ptx;
+        } else {
+            vRecv >> ptx >> vin >> vchSig >> sigTime;
+        }
+        const CTransaction& tx = *ptx;
+
+        if (strCommand == "dstx") {
             //these allow masternodes to publish a limited amount of free transactions
-            vRecv >> tx >> vin >> vchSig >> sigTime;
 
             CMasternode* pmn = mnodeman.Find(vin);
             if (pmn != NULL) {
@@ -6365,10 +6889,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->setAskFor.erase(inv.hash);
         mapAlreadyAskedFor.erase(inv);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees))
+        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees))
         {
             mempool.check(pcoinsTip);
-            RelayTransaction(tx);
+            RelayTransaction(ptx);
             vWorkQueue.push_back(inv.hash);
 
             LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u)\n",
@@ -6388,7 +6912,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                      ++mi)
                 {
                     const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
+                    CTransactionRef porphanTx = mapOrphanTransactions[orphanHash].tx;
                     NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
@@ -6399,10 +6923,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
                     if (setMisbehaving.count(fromPeer))
                         continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
+                    if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2))
                     {
                         LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
+                        RelayTransaction(porphanTx);
                         vWorkQueue.push_back(orphanHash);
                         vEraseQueue.push_back(orphanHash);
                     }
@@ -6436,7 +6960,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                  tx.vShieldedSpend.empty() &&
                  tx.vShieldedOutput.empty())
         {
-            AddOrphanTx(tx, pfrom->GetId());
+            AddOrphanTx(ptx, pfrom->GetId());
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
             unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -6459,7 +6983,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 int nDoS = 0;
                 if (!state.IsInvalid(nDoS) || nDoS == 0) {
                     LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
-                    RelayTransaction(tx);
+                    RelayTransaction(ptx);
                 } else {
                     LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
                         tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
@@ -6563,8 +7087,175 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 LOCK(cs_main);
                 Misbehaving(pfrom->GetId(), nDoS);
             }
+        } else {
+            LOCK(cs_main);
+            if (!IsInitialBlockDownload() && chainActive.Tip()->GetBlockHash() == inv.hash)
+                MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+        }
+
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCmpctBlock = false;
+        uint64_t nCmpctBlockVersion = 0;
+        vRecv >> fAnnounceUsingCmpctBlock >> nCmpctBlockVersion;
+        if (nCmpctBlockVersion == CMPCTBLOCKS_VERSION) {
+            pfrom->fSupportsCompactBlocks = true;
+            pfrom->fPreferHeaderAndIDs = fAnnounceUsingCmpctBlock;
+        }
+    }
+
+
+    else if (strCommand == "sendmnlist")
+    {
+        int nVersion = 0;
+        vRecv >> nVersion;
+        pfrom->nMasternodeListVersion = std::min(nVersion, MASTERNODE_LIST_VERSION);
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("net", "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+
+        BlockTransactions resp;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect to anything we know; fetch the headers in between first
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashBlock);
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            if (!AcceptBlockHeader(cmpctblock.header, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS)) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    LogPrintf("Peer %d sent us invalid header via cmpctblock\n", pfrom->id);
+                }
+                return true;
+            }
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+            bool fAlreadyInFlight = itInFlight != mapBlocksInFlight.end();
+
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                return true;
+
+            // A block that doesn't extend our tip, or one we are too far
+            // behind for our mempool to be of use, is fetched in full: right
+            // away if we already asked for it, otherwise by the regular
+            // header-driven download logic.
+            if (pindex->nChainWork <= chainActive.Tip()->nChainWork || pindex->nTx != 0 ||
+                    pindex->nHeight > chainActive.Height() + 2 ||
+                    (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))) {
+                if (fAlreadyInFlight) {
+                    vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                    pfrom->PushMessage("getdata", vInv);
+                }
+                return true;
+            }
+
+            // Only one peer at a time gets to fill in a given block
+            if (fAlreadyInFlight ? itInFlight->second.first != pfrom->GetId()
+                                 : State(pfrom->GetId())->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+                return true;
+
+            list<QueuedBlock>::iterator itQueued;
+            if (!MarkBlockAsInFlight(pfrom->GetId(), hashBlock, chainparams.GetConsensus(), pindex, &itQueued) &&
+                    itQueued->partialBlock) {
+                LogPrint("net", "Peer %d sent us a cmpctblock we were already rebuilding\n", pfrom->id);
+                return true;
+            }
+            itQueued->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+
+            ReadStatus status = itQueued->partialBlock->InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hashBlock);
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block\n", pfrom->id);
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                pfrom->PushMessage("getdata", vInv);
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                if (!itQueued->partialBlock->IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (!req.indexes.empty()) {
+                req.blockhash = hashBlock;
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+            resp.blockhash = hashBlock;
+        }
+
+        // Our mempool had every transaction, no round trip needed
+        ProcessBlockTransactions(pfrom, resp);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (mi->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // Too old for the peer to be rebuilding it from its mempool; let
+            // the getdata logic, which also applies its own fingerprinting
+            // checks, answer with the full block the next time around.
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            return true;
         }
 
+        std::shared_ptr<const CBlock> pblock;
+        if (!ReadBlockFromDisk(pblock, mi->second))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= pblock->vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = pblock->vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        ProcessBlockTransactions(pfrom, resp);
     }
 
 
@@ -6600,16 +7291,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         mempool.queryHashes(vtxid);
         vector<CInv> vInv;
         BOOST_FOREACH(uint256& hash, vtxid) {
-            CTransaction tx;
-            bool fInMemPool = mempool.lookup(hash, tx);
-            if (fInMemPool && IsExpiringSoonTx(tx, currentHeight + 1)) {
+            CTransactionRef ptx = mempool.get(hash);
+            if (ptx && IsExpiringSoonTx(*ptx, currentHeight + 1)) {
                 continue;
             }
 
             CInv inv(MSG_TX, hash);
             if (pfrom->pfilter) {
-                if (!fInMemPool) continue; // another thread removed since queryHashes, maybe...
-                if (!pfrom->pfilter->IsRelevantAndUpdate(tx)) continue;
+                if (!ptx) continue; // another thread removed since queryHashes, maybe...
+                if (!pfrom->pfilter->IsRelevantAndUpdate(*ptx)) continue;
             }
             vInv.push_back(inv);
             if (vInv.size() == MAX_INV_SZ) {
@@ -6843,6 +7533,63 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_ENFORCEMENT;
 }
 
+/**
+ * Recover the signers of the masternode, budget and SwiftX messages waiting
+ * in pfrom's receive queue as one batch, on the signature check threads, so
+ * that their handlers find them in the signer cache. Syncing the masternode
+ * list and budgets brings these in as thousands of small messages.
+ * Requires cs_vRecvMsg.
+ */
+void static PrefetchMessageSigners(CNode* pfrom)
+{
+    // Still working through the previous batch
+    if (pfrom->nRecvMsgSignersPrefetched > 0)
+        return;
+
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > vMessages;
+    size_t nScanned = 0;
+    for (std::deque<CNetMessage>::const_iterator it = pfrom->vRecvMsg.begin();
+         it != pfrom->vRecvMsg.end() && it->complete() && nScanned < MAX_SIGNER_PREFETCH_MESSAGES; ++it, ++nScanned) {
+        std::string strCommand = it->hdr.GetCommand();
+        CDataStream vRecv(it->vRecv);
+        try {
+            if (strCommand == "mnb") {
+                CMasternodeBroadcast mnb;
+                vRecv >> mnb;
+                vMessages.push_back(std::make_pair(mnb.GetStrMessage(), mnb.sig));
+                vMessages.push_back(std::make_pair(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+            } else if (strCommand == "mnp") {
+                CMasternodePing mnp;
+                vRecv >> mnp;
+                vMessages.push_back(std::make_pair(mnp.GetStrMessage(), mnp.vchSig));
+            } else if (strCommand == "mnw") {
+                CMasternodePaymentWinner winner;
+                vRecv >> winner;
+                vMessages.push_back(std::make_pair(winner.GetStrMessage(), winner.vchSig));
+            } else if (strCommand == "mvote") {
+                CBudgetVote vote;
+                vRecv >> vote;
+                vMessages.push_back(std::make_pair(vote.GetStrMessage(), vote.vchSig));
+            } else if (strCommand == "fbvote") {
+                CFinalizedBudgetVote vote;
+                vRecv >> vote;
+                vMessages.push_back(std::make_pair(vote.GetStrMessage(), vote.vchSig));
+            } else if (strCommand == "txlvote") {
+                CConsensusVote vote;
+                vRecv >> vote;
+                vMessages.push_back(std::make_pair(vote.GetStrMessage(), vote.vchMasterNodeSignature));
+            }
+        } catch (const std::exception&) {
+            // Malformed, leave it to ProcessMessage
+        }
+    }
+    pfrom->nRecvMsgSignersPrefetched = nScanned;
+
+    // A lone message is simply checked by its handler
+    if (vMessages.size() > 1)
+        obfuScationSigner.PrecomputeSigners(vMessages);
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -6865,6 +7612,9 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    if (!fLiteMode)
+        PrefetchMessageSigners(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -6957,8 +7707,11 @@ bool ProcessMessages(CNode* pfrom)
     }
 
     // In case the connection got shut down, its receive buffer was wiped
-    if (!pfrom->fDisconnect)
+    if (!pfrom->fDisconnect) {
+        size_t nProcessed = it - pfrom->vRecvMsg.begin();
+        pfrom->nRecvMsgSignersPrefetched -= std::min(nProcessed, pfrom->nRecvMsgSignersPrefetched);
         pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
+    }
 
     return fOk;
 }
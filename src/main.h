@@ -32,6 +32,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -42,6 +43,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
@@ -69,6 +71,12 @@ static const unsigned int MAX_P2SH_SIGOPS = 15;
 static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Smallest -maxmempool, in megabytes, that still holds the transactions of a full block */
+static const unsigned int MIN_MAX_MEMPOOL_SIZE = 5 * MAX_BLOCK_SIZE_AFTER_UPGRADE / 1000000;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** Default for -txexpirydelta, in number of blocks */
@@ -87,6 +95,8 @@ static const int MAX_SCRIPTCHECK_THREADS = 16;
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Number of queued messages from a peer whose masternode signatures are recovered as one batch. */
+static const unsigned int MAX_SIGNER_PREFETCH_MESSAGES = 256;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -139,6 +149,9 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fTimestampIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -275,9 +288,23 @@ void FlushStateToDisk();
 void PruneAndFlush();
 /** See whether the protocol update is enforced for connected nodes */
 int ActiveProtocol();
-/** (try to) add transaction to memory pool **/
+/**
+ * (try to) add transaction to memory pool; the pool keeps ptx itself.
+ * fOverrideMempoolLimit skips the -maxmempool minimum fee and trimming,
+ * for callers that trim the pool themselves afterwards.
+ **/
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool ignoreFees = false,
+                        bool fOverrideMempoolLimit = false);
+/** (try to) add a copy of tx to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool ignoreFees = false);
+                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool ignoreFees = false,
+                        bool fOverrideMempoolLimit = false);
+
+/** Load the mempool saved by DumpMempool, checking its transactions again */
+bool LoadMempool();
+/** Save the mempool to mempool.dat in the data directory */
+void DumpMempool();
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
@@ -811,6 +838,12 @@ bool GetAddressUnspent(uint160 addressHash, int type,
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read a block through the shared block cache, adding it if it is not there yet */
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+/** Read the serialized bytes of a block from disk without deserializing it */
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -29,6 +29,46 @@ std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
 
 int nSubmittedFinalBudget;
 
+/**
+ * Keep vote as an orphan of hashParent. When a cap is hit, the parent we
+ * asked for longest ago, or its oldest vote, makes room.
+ */
+template <typename T>
+static void AddOrphanBudgetVote(std::map<uint256, std::map<uint256, T> >& mapOrphans, const uint256& hashParent, T& vote)
+{
+    uint256 hash = vote.GetHash();
+    typename std::map<uint256, std::map<uint256, T> >::iterator itParent = mapOrphans.find(hashParent);
+    if (itParent == mapOrphans.end()) {
+        if (mapOrphans.size() >= MAX_ORPHAN_BUDGET_VOTE_PARENTS) {
+            typename std::map<uint256, std::map<uint256, T> >::iterator itOldest = mapOrphans.end();
+            int64_t nOldest = std::numeric_limits<int64_t>::max();
+            for (typename std::map<uint256, std::map<uint256, T> >::iterator it = mapOrphans.begin(); it != mapOrphans.end(); ++it) {
+                std::map<uint256, int64_t>::const_iterator itAsked = askedForSourceProposalOrBudget.find(it->first);
+                int64_t nAsked = itAsked == askedForSourceProposalOrBudget.end() ? 0 : itAsked->second;
+                if (nAsked < nOldest) {
+                    nOldest = nAsked;
+                    itOldest = it;
+                }
+            }
+            LogPrint("mnbudget", "AddOrphanBudgetVote - Too many unknown parents, dropping orphan votes for %s\n", itOldest->first.ToString());
+            mapOrphans.erase(itOldest);
+        }
+        itParent = mapOrphans.insert(std::make_pair(hashParent, std::map<uint256, T>())).first;
+    }
+
+    std::map<uint256, T>& mapVotes = itParent->second;
+    if (mapVotes.count(hash)) return;
+    if (mapVotes.size() >= MAX_ORPHAN_BUDGET_VOTES_PER_PARENT) {
+        typename std::map<uint256, T>::iterator itOldest = mapVotes.begin();
+        for (typename std::map<uint256, T>::iterator it = mapVotes.begin(); it != mapVotes.end(); ++it) {
+            if (it->second.nTime < itOldest->second.nTime)
+                itOldest = it;
+        }
+        mapVotes.erase(itOldest);
+    }
+    mapVotes.insert(std::make_pair(hash, vote));
+}
+
 int GetBudgetPaymentCycleBlocks()
 {
     // Amount of blocks in a months period of time (using 1 minutes per block) = (60*24*30)
@@ -100,31 +140,29 @@ bool IsBudgetCollateralValid(uint256 nTxCollateralHash, uint256 nExpectedHash, s
     }
 }
 
-void CBudgetManager::CheckOrphanVotes()
+void CBudgetManager::CheckOrphanVotes(const uint256& nHash)
 {
     LOCK(cs);
 
-
+    // the parent is known now, so votes it still rejects are dropped rather than kept as orphans
     std::string strError = "";
-    std::map<uint256, CBudgetVote>::iterator it1 = mapOrphanMasternodeBudgetVotes.begin();
-    while (it1 != mapOrphanMasternodeBudgetVotes.end()) {
-        if (budget.UpdateProposal(((*it1).second), NULL, strError)) {
-            LogPrint("masternode","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanMasternodeBudgetVotes.erase(it1++);
-        } else {
-            ++it1;
+    std::map<uint256, std::map<uint256, CBudgetVote> >::iterator it1 = mapOrphanMasternodeBudgetVotes.find(nHash);
+    if (it1 != mapOrphanMasternodeBudgetVotes.end()) {
+        for (std::map<uint256, CBudgetVote>::iterator it = it1->second.begin(); it != it1->second.end(); ++it) {
+            if (UpdateProposal(it->second, NULL, strError))
+                LogPrint("masternode","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
         }
+        mapOrphanMasternodeBudgetVotes.erase(it1);
     }
-    std::map<uint256, CFinalizedBudgetVote>::iterator it2 = mapOrphanFinalizedBudgetVotes.begin();
-    while (it2 != mapOrphanFinalizedBudgetVotes.end()) {
-        if (budget.UpdateFinalizedBudget(((*it2).second), NULL, strError)) {
-            LogPrint("masternode","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanFinalizedBudgetVotes.erase(it2++);
-        } else {
-            ++it2;
+
+    std::map<uint256, std::map<uint256, CFinalizedBudgetVote> >::iterator it2 = mapOrphanFinalizedBudgetVotes.find(nHash);
+    if (it2 != mapOrphanFinalizedBudgetVotes.end()) {
+        for (std::map<uint256, CFinalizedBudgetVote>::iterator it = it2->second.begin(); it != it2->second.end(); ++it) {
+            if (UpdateFinalizedBudget(it->second, NULL, strError))
+                LogPrint("masternode","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
         }
+        mapOrphanFinalizedBudgetVotes.erase(it2);
     }
-    LogPrint("masternode","CBudgetManager::CheckOrphanVotes - Done\n");
 }
 
 void CBudgetManager::SubmitFinalBudget()
@@ -411,6 +449,9 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
     }
 
     mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+
+    //we might have active votes for this budget that are now valid
+    CheckOrphanVotes(finalizedBudget.GetHash());
     return true;
 }
 
@@ -429,6 +470,9 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
 
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
     LogPrint("masternode","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
+
+    //we might have active votes for this proposal that are valid now
+    CheckOrphanVotes(budgetProposal.GetHash());
     return true;
 }
 
@@ -1011,9 +1055,6 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         masternodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash());
 
         LogPrint("masternode","mprop - new budget - %s\n", budgetProposalBroadcast.GetHash().ToString());
-
-        //We might have active votes for this proposal that are valid now
-        CheckOrphanVotes();
     }
 
     if (strCommand == "mvote") { //Masternode Vote
@@ -1087,9 +1128,6 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             finalizedBudgetBroadcast.Relay();
         }
         masternodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash());
-
-        //we might have active votes for this budget that are now valid
-        CheckOrphanVotes();
     }
 
     if (strCommand == "fbvote") { //Finalized Budget Vote
@@ -1295,7 +1333,7 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("masternode","CBudgetManager::UpdateProposal - Unknown proposal %d, asking for source proposal\n", vote.nProposalHash.ToString());
-            mapOrphanMasternodeBudgetVotes[vote.nProposalHash] = vote;
+            AddOrphanBudgetVote(mapOrphanMasternodeBudgetVotes, vote.nProposalHash, vote);
 
             if (!askedForSourceProposalOrBudget.count(vote.nProposalHash)) {
                 pfrom->PushMessage("mnvs", vote.nProposalHash);
@@ -1322,7 +1360,7 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("masternode","CBudgetManager::UpdateFinalizedBudget - Unknown Finalized Proposal %s, asking for source budget\n", vote.nBudgetHash.ToString());
-            mapOrphanFinalizedBudgetVotes[vote.nBudgetHash] = vote;
+            AddOrphanBudgetVote(mapOrphanFinalizedBudgetVotes, vote.nBudgetHash, vote);
 
             if (!askedForSourceProposalOrBudget.count(vote.nBudgetHash)) {
                 pfrom->PushMessage("mnvs", vote.nBudgetHash);
@@ -1648,6 +1686,11 @@ void CBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -1655,7 +1698,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1673,7 +1716,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2091,6 +2134,11 @@ void CFinalizedBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CFinalizedBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -2098,7 +2146,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2117,7 +2165,7 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
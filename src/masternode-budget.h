@@ -36,6 +36,10 @@ class CTxBudgetPayment;
 static const CAmount PROPOSAL_FEE_TX = (50 * COIN);
 static const CAmount BUDGET_FEE_TX = (50 * COIN);
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
+/** Most orphan votes kept for one unknown proposal or budget */
+static const unsigned int MAX_ORPHAN_BUDGET_VOTES_PER_PARENT = 2000;
+/** Most unknown proposals and budgets orphan votes are kept for, of each kind */
+static const unsigned int MAX_ORPHAN_BUDGET_VOTE_PARENTS = 100;
 
 extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
 extern std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
@@ -69,6 +73,8 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
+    /// The message vchSig signs
+    std::string GetStrMessage() const;
     void Relay();
 
     std::string GetVoteString()
@@ -121,6 +127,8 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
+    /// The message vchSig signs
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -189,10 +197,11 @@ public:
 
     std::map<uint256, CBudgetProposalBroadcast> mapSeenMasternodeBudgetProposals;
     std::map<uint256, CBudgetVote> mapSeenMasternodeBudgetVotes;
-    std::map<uint256, CBudgetVote> mapOrphanMasternodeBudgetVotes;
     std::map<uint256, CFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
     std::map<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
-    std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
+    // votes for proposals and budgets we don't know yet, by parent hash then vote hash
+    std::map<uint256, std::map<uint256, CBudgetVote> > mapOrphanMasternodeBudgetVotes;
+    std::map<uint256, std::map<uint256, CFinalizedBudgetVote> > mapOrphanFinalizedBudgetVotes;
 
     CBudgetManager()
     {
@@ -239,7 +248,8 @@ public:
     std::string GetRequiredPaymentsString(int nBlockHeight);
     void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees);
 
-    void CheckOrphanVotes();
+    /// Apply the orphan votes waiting for the proposal or finalized budget nHash
+    void CheckOrphanVotes(const uint256& nHash);
     void Clear()
     {
         LOCK(cs);
@@ -267,8 +277,24 @@ public:
         READWRITE(mapSeenMasternodeBudgetVotes);
         READWRITE(mapSeenFinalizedBudgets);
         READWRITE(mapSeenFinalizedBudgetVotes);
-        READWRITE(mapOrphanMasternodeBudgetVotes);
-        READWRITE(mapOrphanFinalizedBudgetVotes);
+
+        // orphans are stored flat, keyed by vote hash, and indexed again on load
+        std::map<uint256, CBudgetVote> mapOrphanVotes;
+        std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedVotes;
+        if (!ser_action.ForRead()) {
+            for (std::map<uint256, std::map<uint256, CBudgetVote> >::const_iterator it = mapOrphanMasternodeBudgetVotes.begin(); it != mapOrphanMasternodeBudgetVotes.end(); ++it)
+                mapOrphanVotes.insert(it->second.begin(), it->second.end());
+            for (std::map<uint256, std::map<uint256, CFinalizedBudgetVote> >::const_iterator it = mapOrphanFinalizedBudgetVotes.begin(); it != mapOrphanFinalizedBudgetVotes.end(); ++it)
+                mapOrphanFinalizedVotes.insert(it->second.begin(), it->second.end());
+        }
+        READWRITE(mapOrphanVotes);
+        READWRITE(mapOrphanFinalizedVotes);
+        if (ser_action.ForRead()) {
+            for (std::map<uint256, CBudgetVote>::iterator it = mapOrphanVotes.begin(); it != mapOrphanVotes.end(); ++it)
+                mapOrphanMasternodeBudgetVotes[it->second.nProposalHash][it->second.GetHash()] = it->second;
+            for (std::map<uint256, CFinalizedBudgetVote>::iterator it = mapOrphanFinalizedVotes.begin(); it != mapOrphanFinalizedVotes.end(); ++it)
+                mapOrphanFinalizedBudgetVotes[it->second.nBudgetHash][it->second.GetHash()] = it->second;
+        }
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
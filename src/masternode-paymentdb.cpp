@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Vidulum developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-paymentdb.h"
+#include "masternode-payments.h"
+#include "util.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+static const char DB_PAYMENT_VOTE = 'w';
+
+CMasternodePaymentVoteDB* pmnpaymentsdb = NULL;
+
+namespace {
+
+/** Height big-endian, so leveldb orders votes by height */
+struct CPaymentVoteKey {
+    uint32_t nBlockHeight;
+    uint256 hash;
+
+    CPaymentVoteKey() : nBlockHeight(0) {}
+    CPaymentVoteKey(uint32_t nBlockHeightIn, const uint256& hashIn) : nBlockHeight(nBlockHeightIn), hash(hashIn) {}
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 36;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, nBlockHeight);
+        hash.Serialize(s);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        nBlockHeight = ser_readdata32be(s);
+        hash.Unserialize(s);
+    }
+};
+
+/** Seek key for the first vote at or above a height */
+struct CPaymentVoteHeightKey {
+    uint32_t nBlockHeight;
+
+    CPaymentVoteHeightKey(uint32_t nBlockHeightIn) : nBlockHeight(nBlockHeightIn) {}
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 4;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, nBlockHeight);
+    }
+};
+
+} // anon namespace
+
+CMasternodePaymentVoteDB::CMasternodePaymentVoteDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "mnpayments", CDBProfile("mnpayments", nCacheSize), fMemory, fWipe) {}
+
+bool CMasternodePaymentVoteDB::WriteVote(const CMasternodePaymentWinner& winner)
+{
+    CMasternodePaymentWinner copy(winner);
+    return Write(std::make_pair(DB_PAYMENT_VOTE, CPaymentVoteKey(std::max(winner.nBlockHeight, 0), copy.GetHash())), winner);
+}
+
+bool CMasternodePaymentVoteDB::ReadVotes(int nFirstHeight, int nLastHeight, std::vector<CMasternodePaymentWinner>& vWinners)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_PAYMENT_VOTE, CPaymentVoteHeightKey(std::max(nFirstHeight, 0))));
+
+    while (pcursor->Valid()) {
+        std::pair<char, CPaymentVoteKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_PAYMENT_VOTE || (int)key.second.nBlockHeight > nLastHeight)
+            break;
+        CMasternodePaymentWinner winner;
+        if (!pcursor->GetValue(winner))
+            return error("%s : failed to read masternode payment vote at height %d", __func__, key.second.nBlockHeight);
+        vWinners.push_back(winner);
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CMasternodePaymentVoteDB::EraseVotesBelow(int nHeight)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_PAYMENT_VOTE, CPaymentVoteHeightKey(0)));
+
+    CDBBatch batch(*this);
+    int nErased = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CPaymentVoteKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_PAYMENT_VOTE || (int)key.second.nBlockHeight >= nHeight)
+            break;
+        batch.Erase(key);
+        nErased++;
+        pcursor->Next();
+    }
+
+    if (nErased == 0) return true;
+    LogPrint("mnpayments", "CMasternodePaymentVoteDB::EraseVotesBelow - Erasing %d votes below height %d\n", nErased, nHeight);
+    return WriteBatch(batch);
+}
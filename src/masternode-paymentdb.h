@@ -0,0 +1,39 @@
+// Copyright (c) 2018 The Vidulum developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_PAYMENTDB_H
+#define MASTERNODE_PAYMENTDB_H
+
+#include "dbwrapper.h"
+
+#include <vector>
+
+class CMasternodePaymentWinner;
+
+/**
+ * Masternode payment votes on disk (mnpayments/), keyed by block height
+ * first so the votes for a height, or everything below a height, are one
+ * contiguous range. Votes are written once as they are accepted and only
+ * ever removed by pruning.
+ */
+class CMasternodePaymentVoteDB : public CDBWrapper
+{
+public:
+    CMasternodePaymentVoteDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CMasternodePaymentVoteDB(const CMasternodePaymentVoteDB&);
+    void operator=(const CMasternodePaymentVoteDB&);
+
+public:
+    bool WriteVote(const CMasternodePaymentWinner& winner);
+    /** Append the votes for heights nFirstHeight..nLastHeight to vWinners, in height order */
+    bool ReadVotes(int nFirstHeight, int nLastHeight, std::vector<CMasternodePaymentWinner>& vWinners);
+    /** Remove the votes for all heights below nHeight */
+    bool EraseVotesBelow(int nHeight);
+};
+
+extern CMasternodePaymentVoteDB* pmnpaymentsdb;
+
+#endif // MASTERNODE_PAYMENTDB_H
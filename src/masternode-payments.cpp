@@ -8,6 +8,7 @@
 #include "masternode-payments.h"
 #include "addrman.h"
 #include "masternode-budget.h"
+#include "masternode-paymentdb.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
@@ -23,160 +24,8 @@
 /** Object for who's going to get paid on which blocks */
 CMasternodePayments masternodePayments;
 
-CCriticalSection cs_vecPayments;
-CCriticalSection cs_mapMasternodeBlocks;
 CCriticalSection cs_mapMasternodePayeeVotes;
 
-//
-// CMasternodePaymentDB
-//
-
-CMasternodePaymentDB::CMasternodePaymentDB()
-{
-    pathDB = GetDataDir() / "mnpayments.dat";
-    strMagicMessage = "MasternodePayments";
-}
-
-bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint("masternode","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
-}
-
-CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
-{
-    int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode payement cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-
-        // de-serialize data into CMasternodePayments object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
-        objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
-    }
-
-    LogPrint("masternode","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint("masternode","Masternode payments manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
-
-    return Ok;
-}
-
-void DumpMasternodePayments()
-{
-    int64_t nStart = GetTimeMillis();
-
-    CMasternodePaymentDB paymentdb;
-    CMasternodePayments tempPayments;
-
-    LogPrint("masternode","Verifying mnpayments.dat format...\n");
-    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodePaymentDB::FileError)
-        LogPrint("masternode","Missing budgets file - mnpayments.dat, will try to recreate\n");
-    else if (readResult != CMasternodePaymentDB::Ok) {
-        LogPrint("masternode","Error reading mnpayments.dat: ");
-        if (readResult == CMasternodePaymentDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to mnpayments.dat...\n");
-    paymentdb.Write(masternodePayments);
-
-    LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
-}
-
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -200,20 +49,20 @@ bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue)
         if (nHeight % GetBudgetPaymentCycleBlocks() < 100) {
             return true;
         } else {
-            if(block.vtx[0].GetValueOut() > nExpectedValue) return false;
+            if(block.vtx[0]->GetValueOut() > nExpectedValue) return false;
         }
     } else { // we're synced and have data so check the budget schedule
 
         //are these blocks even enabled
         if (!IsSporkActive(SPORK_13_ENABLE_SUPERBLOCKS)) {
-            if(block.vtx[0].GetValueOut() > nExpectedValue) return false;
+            if(block.vtx[0]->GetValueOut() > nExpectedValue) return false;
         }
 
         if (budget.IsBudgetPaymentBlock(nHeight)) {
             //the value of the block is evaluated in CheckBlock
             return true;
         } else {
-            if(block.vtx[0].GetValueOut() > nExpectedValue) return false;
+            if(block.vtx[0]->GetValueOut() > nExpectedValue) return false;
         }
     }
 
@@ -227,7 +76,7 @@ bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight)
         return true;
     }
 
-    const CTransaction& txNew = block.vtx[0];
+    const CTransaction& txNew = *block.vtx[0];
 
     //check if it's a budget block
     if (IsSporkActive(SPORK_13_ENABLE_SUPERBLOCKS)) {
@@ -386,7 +235,7 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
             nHeight = chainActive.Tip()->nHeight;
         }
 
-        if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash())) {
+        if (masternodePayments.HasPaymentVote(winner.GetHash())) {
             LogPrint("mnpayments", "mnw - Already seen - %s bestHeight %d\n", winner.GetHash().ToString().c_str(), nHeight);
             masternodeSync.AddedMasternodeWinner(winner.GetHash());
             return;
@@ -432,14 +281,19 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
     }
 }
 
+std::string CMasternodePaymentWinner::GetStrMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         return false;
@@ -452,21 +306,104 @@ bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasterno
     return true;
 }
 
+void CMasternodePayments::LoadVotes(int nFirstHeight, int nLastHeight)
+{
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+        int nHeight = nFirstHeight;
+        while (nHeight <= nLastHeight && setLoadedHeights.count(nHeight))
+            nHeight++;
+        if (nHeight > nLastHeight) return;
+        nFirstHeight = nHeight;
+    }
+
+    // Read outside the locks, the store is only iterated here. Votes that
+    // arrive meanwhile are in both the store and the maps, the merge below
+    // skips them by hash.
+    std::vector<CMasternodePaymentWinner> vWinners;
+    if (pmnpaymentsdb != NULL && !pmnpaymentsdb->ReadVotes(nFirstHeight, nLastHeight, vWinners)) {
+        LogPrintf("CMasternodePayments::LoadVotes - Failed to read votes for blocks %d-%d\n", nFirstHeight, nLastHeight);
+        return;
+    }
+
+    LOCK(cs_mapMasternodePayeeVotes);
+    boost::unique_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+
+    BOOST_FOREACH (CMasternodePaymentWinner& winner, vWinners) {
+        // Another thread may have loaded this height meanwhile
+        if (setLoadedHeights.count(winner.nBlockHeight)) continue;
+
+        uint256 hash = winner.GetHash();
+        if (mapMasternodePayeeVotes.count(hash)) continue;
+        mapMasternodePayeeVotes[hash] = winner;
+
+        std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(winner.nBlockHeight);
+        if (it == mapMasternodeBlocks.end())
+            it = mapMasternodeBlocks.insert(std::make_pair(winner.nBlockHeight, CMasternodeBlockPayees(winner.nBlockHeight))).first;
+        it->second.AddPayee(winner.payee, 1);
+    }
+
+    for (int nHeight = nFirstHeight; nHeight <= nLastHeight; nHeight++)
+        setLoadedHeights.insert(nHeight);
+
+    if (!vWinners.empty())
+        LogPrint("mnpayments", "CMasternodePayments::LoadVotes - Loaded %d votes for blocks %d-%d\n", vWinners.size(), nFirstHeight, nLastHeight);
+}
+
 bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
 {
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].GetPayee(payee);
+    LoadVotes(nBlockHeight, nBlockHeight);
+
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+    std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it != mapMasternodeBlocks.end()) {
+        return it->second.GetPayee(payee);
     }
 
     return false;
 }
 
+bool CMasternodePayments::HasPayeeWithVotes(int nBlockHeight, const CScript& payee, int nVotesReq)
+{
+    LoadVotes(nBlockHeight, nBlockHeight);
+
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+    std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    return it != mapMasternodeBlocks.end() && it->second.HasPayeeWithVotes(payee, nVotesReq);
+}
+
+void CMasternodePayments::GetPayeesWithVotes(int nFirstHeight, int nLastHeight, int nVotesReq, std::map<CScript, int>& mapLastPaidRet)
+{
+    LoadVotes(nFirstHeight, nLastHeight);
+
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+    std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.lower_bound(nFirstHeight);
+    for (; it != mapMasternodeBlocks.end() && it->first <= nLastHeight; ++it) {
+        BOOST_FOREACH (const CMasternodePayee& p, it->second.vecPayments) {
+            if (p.nVotes >= nVotesReq) mapLastPaidRet[p.scriptPubKey] = it->first;
+        }
+    }
+}
+
+bool CMasternodePayments::HasPaymentVote(const uint256& hash)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    return mapMasternodePayeeVotes.count(hash);
+}
+
+bool CMasternodePayments::GetPaymentVote(const uint256& hash, CMasternodePaymentWinner& winner)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    std::map<uint256, CMasternodePaymentWinner>::const_iterator it = mapMasternodePayeeVotes.find(hash);
+    if (it == mapMasternodePayeeVotes.end()) return false;
+    winner = it->second;
+    return true;
+}
+
 // Is this masternode scheduled to get paid soon?
 // -- Only look ahead up to 8 blocks to allow for propagation of the latest 2 winners
 bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
 {
-    LOCK(cs_mapMasternodeBlocks);
-
     int nHeight;
     {
         TRY_LOCK(cs_main, locked);
@@ -474,14 +411,18 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
         nHeight = chainActive.Tip()->nHeight;
     }
 
+    LoadVotes(nHeight, nHeight + 8);
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+
     CScript mnpayee;
     mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
 
     CScript payee;
     for (int64_t h = nHeight; h <= nHeight + 8; h++) {
         if (h == nNotBlockHeight) continue;
-        if (mapMasternodeBlocks.count(h)) {
-            if (mapMasternodeBlocks[h].GetPayee(payee)) {
+        std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.find(h);
+        if (it != mapMasternodeBlocks.end()) {
+            if (it->second.GetPayee(payee)) {
                 if (mnpayee == payee) {
                     return true;
                 }
@@ -500,8 +441,11 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         return false;
     }
 
+    // The stored votes for this height have to be counted before new ones
+    LoadVotes(winnerIn.nBlockHeight, winnerIn.nBlockHeight);
+
     {
-        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+        LOCK(cs_mapMasternodePayeeVotes);
 
         if (mapMasternodePayeeVotes.count(winnerIn.GetHash())) {
             return false;
@@ -509,21 +453,21 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
 
         mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
 
-        if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
-            CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
-            mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
-        }
+        boost::unique_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+        std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(winnerIn.nBlockHeight);
+        if (it == mapMasternodeBlocks.end())
+            it = mapMasternodeBlocks.insert(std::make_pair(winnerIn.nBlockHeight, CMasternodeBlockPayees(winnerIn.nBlockHeight))).first;
+        it->second.AddPayee(winnerIn.payee, 1);
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    if (pmnpaymentsdb != NULL && !pmnpaymentsdb->WriteVote(winnerIn))
+        LogPrintf("CMasternodePayments::AddWinningMasternode - Failed to store vote %s\n", winnerIn.GetHash().ToString());
 
     return true;
 }
 
-bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
+bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew) const
 {
-    LOCK(cs_vecPayments);
-
 	int nMaxSignatures = 0;
     int nMasternode_Drift_Count = 0;
 
@@ -545,7 +489,7 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
     CAmount requiredMasternodePayment = GetMasternodePayment(nBlockHeight, nReward, nMasternode_Drift_Count);
 	
 	//require at least 6 signatures
-	BOOST_FOREACH (CMasternodePayee& payee, vecPayments)
+	BOOST_FOREACH (const CMasternodePayee& payee, vecPayments)
     {
         LogPrint("masternode","Masternode payment nVotes=%d nMaxSignatures=%d\n", payee.nVotes, nMaxSignatures);
 		if (payee.nVotes >= nMaxSignatures && payee.nVotes >= MNPAYMENTS_SIGNATURES_REQUIRED)
@@ -555,7 +499,7 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 	//if we don't have at least 6 signatures on a payee, approve whichever is the longest chain
 	if (nMaxSignatures < MNPAYMENTS_SIGNATURES_REQUIRED) return true;
 
-    BOOST_FOREACH (CMasternodePayee& payee, vecPayments) {
+    BOOST_FOREACH (const CMasternodePayee& payee, vecPayments) {
         bool found = false;
         BOOST_FOREACH (CTxOut out, txNew.vout) {
             if (payee.scriptPubKey == out.scriptPubKey) {
@@ -586,13 +530,11 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
     return false;
 }
 
-std::string CMasternodeBlockPayees::GetRequiredPaymentsString()
+std::string CMasternodeBlockPayees::GetRequiredPaymentsString() const
 {
-    LOCK(cs_vecPayments);
-
     std::string ret = "Unknown";
 
-    BOOST_FOREACH (CMasternodePayee& payee, vecPayments) {
+    BOOST_FOREACH (const CMasternodePayee& payee, vecPayments) {
         CTxDestination address1;
         ExtractDestination(payee.scriptPubKey, address1);
 
@@ -608,10 +550,12 @@ std::string CMasternodeBlockPayees::GetRequiredPaymentsString()
 
 std::string CMasternodePayments::GetRequiredPaymentsString(int nBlockHeight)
 {
-    LOCK(cs_mapMasternodeBlocks);
+    LoadVotes(nBlockHeight, nBlockHeight);
 
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].GetRequiredPaymentsString();
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+    std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it != mapMasternodeBlocks.end()) {
+        return it->second.GetRequiredPaymentsString();
     }
 
     return "Unknown";
@@ -619,44 +563,65 @@ std::string CMasternodePayments::GetRequiredPaymentsString(int nBlockHeight)
 
 bool CMasternodePayments::IsTransactionValid(const CTransaction& txNew, int nBlockHeight)
 {
-    LOCK(cs_mapMasternodeBlocks);
+    LoadVotes(nBlockHeight, nBlockHeight);
+
+    // Check against a copy, so the masternode list lookups below don't
+    // hold up vote ingestion
+    CMasternodeBlockPayees blockPayees;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
 
-    LogPrint("masternode", "mapMasternodeBlocks size = %d, nBlockHeight = %d", mapMasternodeBlocks.size(), nBlockHeight);
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        LogPrint("masternode", "mapMasternodeBlocks check transaction");
-        return mapMasternodeBlocks[nBlockHeight].IsTransactionValid(txNew);
+        LogPrint("masternode", "mapMasternodeBlocks size = %d, nBlockHeight = %d", mapMasternodeBlocks.size(), nBlockHeight);
+        std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.find(nBlockHeight);
+        if (it == mapMasternodeBlocks.end())
+            return true;
+        blockPayees = it->second;
     }
 
-    return true;
+    LogPrint("masternode", "mapMasternodeBlocks check transaction");
+    return blockPayees.IsTransactionValid(txNew);
 }
 
 void CMasternodePayments::CleanPaymentList()
 {
-    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
-
-    int nHeight;
+    int nEraseBelow;
     {
-        TRY_LOCK(cs_main, locked);
-        if (!locked || chainActive.Tip() == NULL) return;
-        nHeight = chainActive.Tip()->nHeight;
-    }
+        LOCK(cs_mapMasternodePayeeVotes);
+        boost::unique_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
+
+        int nHeight;
+        {
+            TRY_LOCK(cs_main, locked);
+            if (!locked || chainActive.Tip() == NULL) return;
+            nHeight = chainActive.Tip()->nHeight;
+        }
 
-    //keep up to five cycles for historical sake
-    int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
+        //keep up to five cycles for historical sake
+        int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
+        std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
+        while (it != mapMasternodePayeeVotes.end()) {
+            CMasternodePaymentWinner winner = (*it).second;
 
-        if (nHeight - winner.nBlockHeight > nLimit) {
-            LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
-            mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
+            if (nHeight - winner.nBlockHeight > nLimit) {
+                LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
+                masternodeSync.mapSeenSyncMNW.erase((*it).first);
+                mapMasternodePayeeVotes.erase(it++);
+                mapMasternodeBlocks.erase(winner.nBlockHeight);
+            } else {
+                ++it;
+            }
         }
+
+        // Forget which old heights were loaded
+        nEraseBelow = nHeight - nLimit;
+        setLoadedHeights.erase(setLoadedHeights.begin(), setLoadedHeights.lower_bound(nEraseBelow));
     }
+
+    // Prune the vote store after releasing the locks, so vote and payee
+    // lookups don't wait for the range scan
+    if (pmnpaymentsdb != NULL)
+        pmnpaymentsdb->EraseVotesBelow(nEraseBelow);
 }
 
 bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
@@ -774,9 +739,7 @@ bool CMasternodePaymentWinner::SignatureValid()
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -791,8 +754,6 @@ bool CMasternodePaymentWinner::SignatureValid()
 
 void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
 {
-    LOCK(cs_mapMasternodePayeeVotes);
-
     int nHeight;
     {
         TRY_LOCK(cs_main, locked);
@@ -803,6 +764,9 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
     int nCount = (mnodeman.CountEnabled() * 1.25);
     if (nCountNeeded > nCount) nCountNeeded = nCount;
 
+    LoadVotes(nHeight - nCountNeeded, nHeight + 20);
+    LOCK(cs_mapMasternodePayeeVotes);
+
     int nInvCount = 0;
     std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
@@ -828,7 +792,7 @@ std::string CMasternodePayments::ToString() const
 
 int CMasternodePayments::GetOldestBlock()
 {
-    LOCK(cs_mapMasternodeBlocks);
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
 
     int nOldestBlock = std::numeric_limits<int>::max();
 
@@ -846,7 +810,7 @@ int CMasternodePayments::GetOldestBlock()
 
 int CMasternodePayments::GetNewestBlock()
 {
-    LOCK(cs_mapMasternodeBlocks);
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
 
     int nNewestBlock = 0;
 
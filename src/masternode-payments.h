@@ -12,11 +12,10 @@
 #include "main.h"
 #include "masternode.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 using namespace std;
 
-extern CCriticalSection cs_vecPayments;
-extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
 
 class CMasternodePayments;
@@ -34,32 +33,6 @@ std::string GetRequiredPaymentsString(int nBlockHeight);
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue);
 void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees);
 
-void DumpMasternodePayments();
-
-/** Save Masternode Payment Data (mnpayments.dat)
- */
-class CMasternodePaymentDB
-{
-private:
-    boost::filesystem::path pathDB;
-    std::string strMagicMessage;
-
-public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
-    };
-
-    CMasternodePaymentDB();
-    bool Write(const CMasternodePayments& objToSave);
-    ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
-};
-
 class CMasternodePayee
 {
 public:
@@ -88,7 +61,8 @@ public:
     }
 };
 
-// Keep track of votes for payees from masternodes
+// Keep track of votes for payees from masternodes. The instances held by
+// CMasternodePayments are guarded by its cs_mapMasternodeBlocks.
 class CMasternodeBlockPayees
 {
 public:
@@ -108,8 +82,6 @@ public:
 
     void AddPayee(CScript payeeIn, int nIncrement)
     {
-        LOCK(cs_vecPayments);
-
         BOOST_FOREACH (CMasternodePayee& payee, vecPayments) {
             if (payee.scriptPubKey == payeeIn) {
                 payee.nVotes += nIncrement;
@@ -121,12 +93,10 @@ public:
         vecPayments.push_back(c);
     }
 
-    bool GetPayee(CScript& payee)
+    bool GetPayee(CScript& payee) const
     {
-        LOCK(cs_vecPayments);
-
         int nVotes = -1;
-        BOOST_FOREACH (CMasternodePayee& p, vecPayments) {
+        BOOST_FOREACH (const CMasternodePayee& p, vecPayments) {
             if (p.nVotes > nVotes) {
                 payee = p.scriptPubKey;
                 nVotes = p.nVotes;
@@ -136,19 +106,17 @@ public:
         return (nVotes > -1);
     }
 
-    bool HasPayeeWithVotes(CScript payee, int nVotesReq)
+    bool HasPayeeWithVotes(const CScript& payee, int nVotesReq) const
     {
-        LOCK(cs_vecPayments);
-
-        BOOST_FOREACH (CMasternodePayee& p, vecPayments) {
+        BOOST_FOREACH (const CMasternodePayee& p, vecPayments) {
             if (p.nVotes >= nVotesReq && p.scriptPubKey == payee) return true;
         }
 
         return false;
     }
 
-    bool IsTransactionValid(const CTransaction& txNew);
-    std::string GetRequiredPaymentsString();
+    bool IsTransactionValid(const CTransaction& txNew) const;
+    std::string GetRequiredPaymentsString() const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -197,6 +165,8 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
+    /// The message vchSig signs
+    std::string GetStrMessage() const;
     void Relay();
 
     void AddPayee(CScript payeeIn)
@@ -231,6 +201,11 @@ public:
 // Masternode Payments Class
 // Keeps track of who should get paid for which blocks
 //
+// Accepted votes are appended to the vote store (pmnpaymentsdb) and pulled
+// back into memory one height at a time, the first time that height is
+// looked at. Lookups by height share cs_mapMasternodeBlocks for reading, so
+// block validation does not queue behind vote ingestion.
+//
 
 class CMasternodePayments
 {
@@ -238,6 +213,15 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // Guards mapMasternodeBlocks and setLoadedHeights. Taken after
+    // cs_mapMasternodePayeeVotes.
+    mutable boost::shared_mutex cs_mapMasternodeBlocks;
+    // Heights whose votes have been read from the vote store
+    std::set<int> setLoadedHeights;
+
+    /// Make sure the stored votes for heights nFirstHeight..nLastHeight are in memory
+    void LoadVotes(int nFirstHeight, int nLastHeight);
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -251,8 +235,10 @@ public:
 
     void Clear()
     {
-        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+        LOCK(cs_mapMasternodePayeeVotes);
+        boost::unique_lock<boost::shared_mutex> lock(cs_mapMasternodeBlocks);
         mapMasternodeBlocks.clear();
+        setLoadedHeights.clear();
         mapMasternodePayeeVotes.clear();
     }
 
@@ -264,8 +250,13 @@ public:
     int LastPayment(CMasternode& mn);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
+    bool HasPayeeWithVotes(int nBlockHeight, const CScript& payee, int nVotesReq);
+    /// Record in mapLastPaidRet the highest height in nFirstHeight..nLastHeight each payee has nVotesReq votes at
+    void GetPayeesWithVotes(int nFirstHeight, int nLastHeight, int nVotesReq, std::map<CScript, int>& mapLastPaidRet);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
+    bool HasPaymentVote(const uint256& hash);
+    bool GetPaymentVote(const uint256& hash, CMasternodePaymentWinner& winner);
 
     bool CanVote(COutPoint outMasternode, int nBlockHeight)
     {
@@ -289,15 +280,6 @@ public:
     std::string ToString() const;
     int GetOldestBlock();
     int GetNewestBlock();
-
-    ADD_SERIALIZE_METHODS;
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action)
-    {
-        READWRITE(mapMasternodePayeeVotes);
-        READWRITE(mapMasternodeBlocks);
-    }
 };
 
 
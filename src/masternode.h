@@ -63,6 +63,8 @@ public:
 
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
+    /// The message vchSig signs
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -300,6 +302,8 @@ public:
     CMasternodeBroadcast(const CMasternode& mn);
 
     bool CheckAndUpdate(int& nDoS);
+    /// The message sig signs
+    std::string GetStrMessage() const;
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(CKey& keyCollateralAddress);
     void Relay();
@@ -199,6 +199,14 @@ void DumpMasternodes()
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
+    nListCacheTime = 0;
+    pindexLastPaid = NULL;
+    nLastPaidWindow = 0;
+    nLastPaidFirstHeight = 0;
+    pindexPaymentQueue = NULL;
+    fPaymentQueueDirty = true;
+    nListRequestPeer = -1;
+    nListPagesExpected = 0;
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -212,6 +220,8 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        mapMasternodeIndex[mn.vin.prevout] = vMasternodes.size() - 1;
+        fPaymentQueueDirty = true;
         return true;
     }
 
@@ -286,6 +296,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             ++it;
         }
     }
+    if (mapMasternodeIndex.size() != vMasternodes.size()) RebuildIndex();
 
     // check who's asked for the Masternode list
     map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
@@ -321,8 +332,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
     while (it3 != mapSeenMasternodeBroadcast.end()) {
         if ((*it3).second.lastPing.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
+            masternodeSync.mapSeenSyncMNB.erase((*it3).first);
             mapSeenMasternodeBroadcast.erase(it3++);
-            masternodeSync.mapSeenSyncMNB.erase((*it3).second.GetHash());
         } else {
             ++it3;
         }
@@ -343,12 +354,26 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapMasternodeIndex.clear();
+    setPaymentQueue.clear();
+    fPaymentQueueDirty = true;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
     nDsqCount = 0;
+    nListCacheTime = 0;
+    hashListCache.SetNull();
+    vListCacheEntries.clear();
+    vListCachePages.clear();
+    dqListHistory.clear();
+    hashLastReceivedList.SetNull();
+    nListRequestPeer = -1;
+    hashListRequestBase.SetNull();
+    hashListReceiving.SetNull();
+    nListPagesExpected = 0;
+    setListPagesReceived.clear();
 }
 
 int CMasternodeMan::stable_size ()
@@ -433,11 +458,116 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    if (pnode->nMasternodeListVersion >= MASTERNODE_LIST_VERSION) {
+        pnode->PushMessage("mnlistget", hashLastReceivedList);
+        nListRequestPeer = pnode->GetId();
+        hashListRequestBase = hashLastReceivedList;
+        hashListReceiving.SetNull();
+        nListPagesExpected = 0;
+        setListPagesReceived.clear();
+    } else
+        pnode->PushMessage("dseg", CTxIn());
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
+static std::vector<CDataStream> SerializeListPages(const std::vector<CMasternodeBroadcast>& vEntries)
+{
+    std::vector<CDataStream> vPages;
+    size_t nPos = 0;
+    do {
+        size_t nEnd = std::min(nPos + MASTERNODE_LIST_PAGE_SIZE, vEntries.size());
+        std::vector<CMasternodeBroadcast> vPage(vEntries.begin() + nPos, vEntries.begin() + nEnd);
+        vPages.push_back(CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+        vPages.back() << vPage;
+        nPos = nEnd;
+    } while (nPos < vEntries.size());
+    return vPages;
+}
+
+void CMasternodeMan::UpdateListCache()
+{
+    AssertLockHeld(cs);
+
+    if (nListCacheTime + MASTERNODES_LIST_CACHE_SECONDS > GetTime()) return;
+    nListCacheTime = GetTime();
+
+    // Same selection dseg announces
+    std::vector<CMasternodeBroadcast> vEntries;
+    std::map<COutPoint, uint256> mapEntries;
+    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+        if (mn.addr.IsRFC1918()) continue; //local network
+        if (!mn.IsEnabled()) continue;
+
+        CMasternodeBroadcast mnb = CMasternodeBroadcast(mn);
+        uint256 hash = mnb.GetHash();
+        if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(make_pair(hash, mnb));
+
+        // Covers the ping too, so a delta carries entries that were only pinged
+        mapEntries[mn.vin.prevout] = SerializeHash(mnb);
+        vEntries.push_back(mnb);
+    }
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mapEntries;
+    uint256 hashList = ss.GetHash();
+    if (hashList == hashListCache && !vListCachePages.empty()) return;
+
+    hashListCache = hashList;
+    vListCacheEntries.swap(vEntries);
+    vListCachePages = SerializeListPages(vListCacheEntries);
+
+    dqListHistory.push_back(std::make_pair(hashList, std::map<COutPoint, uint256>()));
+    dqListHistory.back().second.swap(mapEntries);
+    if (dqListHistory.size() > MASTERNODE_LIST_HISTORY_SIZE)
+        dqListHistory.pop_front();
+
+    LogPrint("masternode", "CMasternodeMan::UpdateListCache - list %s, %d entries in %d pages\n",
+        hashListCache.ToString(), vListCacheEntries.size(), vListCachePages.size());
+}
+
+int CMasternodeMan::PushMasternodeList(CNode* pnode, const uint256& hashBase)
+{
+    LOCK(cs);
+    UpdateListCache();
+
+    const std::map<COutPoint, uint256>* pmapBase = NULL;
+    if (!hashBase.IsNull()) {
+        for (size_t i = 0; i < dqListHistory.size(); i++) {
+            if (dqListHistory[i].first == hashBase) {
+                pmapBase = &dqListHistory[i].second;
+                break;
+            }
+        }
+    }
+
+    if (pmapBase == NULL) {
+        // Full snapshot, straight from the cache
+        int nPages = vListCachePages.size();
+        for (int nPage = 0; nPage < nPages; nPage++)
+            pnode->PushMessage("mnlist", hashListCache, uint256(), nPage, nPages, vListCachePages[nPage]);
+        LogPrint("masternode", "mnlistget - Sent snapshot of %d Masternode entries to peer %i\n", vListCacheEntries.size(), pnode->GetId());
+        return vListCacheEntries.size();
+    }
+
+    // Delta: the entries that are new or changed since hashBase. Removals
+    // are not sent, the peer expires those entries on its own.
+    const std::map<COutPoint, uint256>& mapCurrent = dqListHistory.back().second;
+    std::vector<CMasternodeBroadcast> vDelta;
+    BOOST_FOREACH (const CMasternodeBroadcast& mnb, vListCacheEntries) {
+        std::map<COutPoint, uint256>::const_iterator itBase = pmapBase->find(mnb.vin.prevout);
+        if (itBase == pmapBase->end() || itBase->second != mapCurrent.find(mnb.vin.prevout)->second)
+            vDelta.push_back(mnb);
+    }
+
+    std::vector<CDataStream> vPages = SerializeListPages(vDelta);
+    int nPages = vPages.size();
+    for (int nPage = 0; nPage < nPages; nPage++)
+        pnode->PushMessage("mnlist", hashListCache, hashBase, nPage, nPages, vPages[nPage]);
+    LogPrint("masternode", "mnlistget - Sent delta of %d Masternode entries since %s to peer %i\n", vDelta.size(), hashBase.ToString(), pnode->GetId());
+    return vDelta.size();
+}
+
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
@@ -455,11 +585,90 @@ CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
+    std::map<COutPoint, size_t>::const_iterator it = mapMasternodeIndex.find(vin.prevout);
+    if (it == mapMasternodeIndex.end()) return NULL;
+    return &vMasternodes[it->second];
+}
+
+void CMasternodeMan::RebuildIndex()
+{
+    LOCK(cs);
+
+    mapMasternodeIndex.clear();
+    for (size_t i = 0; i < vMasternodes.size(); i++)
+        mapMasternodeIndex[vMasternodes[i].vin.prevout] = i;
+    fPaymentQueueDirty = true;
+}
+
+void CMasternodeMan::UpdateLastPaid()
+{
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexTip == NULL || pindexTip == pindexLastPaid) return;
+
+    // the same number of blocks CMasternode::GetLastPaid used to walk back
+    int nWindow = CountEnabled() * 1.25;
+    int nFirstHeight = std::max(1, pindexTip->nHeight - nWindow + 1);
+
+    int nScanFrom = nFirstHeight;
+    if (pindexLastPaid != NULL && nFirstHeight >= nLastPaidFirstHeight &&
+        pindexTip->GetAncestor(pindexLastPaid->nHeight) == pindexLastPaid) {
+        nScanFrom = std::max(nLastPaidFirstHeight, pindexLastPaid->nHeight - MASTERNODE_LAST_PAID_RESCAN_BLOCKS + 1);
+    } else {
+        mapPayeeLastPaid.clear();
+        nLastPaidFirstHeight = nFirstHeight;
+    }
+
+    masternodePayments.GetPayeesWithVotes(nScanFrom, pindexTip->nHeight, 2, mapPayeeLastPaid);
+    pindexLastPaid = pindexTip;
+    nLastPaidWindow = nWindow;
+}
+
+int64_t CMasternodeMan::GetLastPaid(const CMasternode& mn)
+{
+    LOCK(cs);
+    UpdateLastPaid();
+    if (pindexLastPaid == NULL) return 0;
+
+    std::map<CScript, int>::const_iterator it = mapPayeeLastPaid.find(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+    if (it == mapPayeeLastPaid.end() || it->second <= pindexLastPaid->nHeight - nLastPaidWindow) return 0;
+
+    const CBlockIndex* pindex = pindexLastPaid->GetAncestor(it->second);
+    if (pindex == NULL) return 0;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mn.vin;
+    ss << mn.sigTime;
+    uint256 hash = ss.GetHash();
+
+    // use a deterministic offset to break a tie -- 2.5 minutes
+    int64_t nOffset = (UintToArith256(hash)).GetCompact(false) % 150;
+
+    return pindex->nTime + nOffset;
+}
+
+void CMasternodeMan::UpdatePaymentQueue()
+{
+    UpdateLastPaid();
+    if (!fPaymentQueueDirty && pindexPaymentQueue == pindexLastPaid) return;
+
+    // Same order as sorting by CMasternode::SecondsSincePayment, high to low: masternodes
+    // not paid for a month come first, ordered by their deterministic hash, then the rest
+    // by the time of their last payment
+    int64_t nMonthAgo = GetAdjustedTime() - 60 * 60 * 24 * 30;
+    setPaymentQueue.clear();
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
+        int64_t nKey = GetLastPaid(mn);
+        if (nKey <= nMonthAgo) {
+            CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+            ss << mn.vin;
+            ss << mn.sigTime;
+            nKey = -(int64_t)UintToArith256(ss.GetHash()).GetCompact(false);
+        }
+        setPaymentQueue.insert(make_pair(nKey, mn.vin.prevout));
     }
-    return NULL;
+
+    pindexPaymentQueue = pindexLastPaid;
+    fPaymentQueueDirty = false;
 }
 
 
@@ -493,14 +702,31 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     LOCK(cs);
 
     CMasternode* pBestMasternode = NULL;
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeLastPaid;
+    UpdatePaymentQueue();
+
+    uint256 blockHash;
+    bool fBlockHash = GetBlockHash(blockHash, nBlockHeight - 101);
+
+    // Look at 1/10 of the oldest nodes (by last payment), calculate their scores and pay the best one
+    //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
+    //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
+    //  -- (chance per block * chances before IsScheduled will fire)
+    int nMnCount = CountEnabled();
+    int nTenthNetwork = std::max(1, nMnCount / 10);
+    int nCountTenth = 0;
+    arith_uint256 nHighest = 0;
 
     /*
-        Make a vector with all of the last paid times
+        Walk the masternodes longest unpaid first, counting all that can be paid
+        and scoring the first tenth of them
     */
 
-    int nMnCount = CountEnabled();
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    nCount = 0;
+    for (std::set<std::pair<int64_t, COutPoint> >::const_iterator it = setPaymentQueue.begin(); it != setPaymentQueue.end(); ++it) {
+        std::map<COutPoint, size_t>::const_iterator itIndex = mapMasternodeIndex.find(it->second);
+        if (itIndex == mapMasternodeIndex.end()) continue;
+        CMasternode& mn = vMasternodes[itIndex->second];
+
         mn.Check();
         if (!mn.IsEnabled()) continue;
 
@@ -516,42 +742,25 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(), mn.vin));
+        nCount++;
+        if (fBlockHash && nCountTenth < nTenthNetwork) {
+            arith_uint256 n = mn.CalculateScore(blockHash);
+            if (n > nHighest) {
+                nHighest = n;
+                pBestMasternode = &mn;
+            }
+            nCountTenth++;
+        }
     }
 
-    nCount = (int)vecMasternodeLastPaid.size();
-
     //when the network is in the process of upgrading, don't penalize nodes that recently restarted
     if (fFilterSigTime && nCount < nMnCount / 3) return GetNextMasternodeInQueueForPayment(nBlockHeight, false, nCount);
 
-    // Sort them high to low
-    sort(vecMasternodeLastPaid.rbegin(), vecMasternodeLastPaid.rend(), CompareLastPaid());
-
-    uint256 blockHash;
-    if(!GetBlockHash(blockHash, nBlockHeight - 101)) {
+    if (!fBlockHash) {
         LogPrintf("CMasternode::GetNextMasternodeInQueueForPayment -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", nBlockHeight - 101);
         return NULL;
     }
 
-    // Look at 1/10 of the oldest nodes (by last payment), calculate their scores and pay the best one
-    //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
-    //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
-    //  -- (chance per block * chances before IsScheduled will fire)
-    int nTenthNetwork = nMnCount / 10;
-    int nCountTenth = 0;
-    arith_uint256 nHighest = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeLastPaid) {
-        CMasternode* pmn = Find(s.second);
-        if (!pmn) break;
-
-        arith_uint256 n = pmn->CalculateScore(blockHash);
-        if (n > nHighest) {
-            nHighest = n;
-            pBestMasternode = pmn;
-        }
-        nCountTenth++;
-        if (nCountTenth >= nTenthNetwork) break;
-    }
     return pBestMasternode;
 }
 
@@ -615,15 +824,14 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+bool CMasternodeMan::GetRankedMasternodes(std::vector<pair<int64_t, CTxIn> >& vecMasternodeScores, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
     //make sure we know about this block
     uint256 blockHash = uint256();
-    if (!GetBlockHash(blockHash, nBlockHeight)) return -1;
+    if (!GetBlockHash(blockHash, nBlockHeight)) return false;
 
     // scan for winner
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
@@ -650,6 +858,13 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     }
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    return true;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetRankedMasternodes(vecMasternodeScores, nBlockHeight, minProtocol, fOnlyActive)) return -1;
 
     int rank = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
@@ -662,6 +877,19 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     return -1;
 }
 
+bool CMasternodeMan::GetMasternodeRankIndex(std::map<COutPoint, int>& mapRanksRet, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetRankedMasternodes(vecMasternodeScores, nBlockHeight, minProtocol, fOnlyActive)) return false;
+
+    mapRanksRet.clear();
+    int rank = 0;
+    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores)
+        mapRanksRet.insert(make_pair(s.second.prevout, ++rank));
+
+    return true;
+}
+
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
@@ -752,6 +980,63 @@ void CMasternodeMan::ProcessMasternodeConnections()
     }
 }
 
+void CMasternodeMan::ProcessBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb)
+{
+    if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
+        masternodeSync.AddedMasternodeList(mnb.GetHash());
+        return;
+    }
+    mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+
+    int nDoS = 0;
+    if (!mnb.CheckAndUpdate(nDoS)) {
+        if (nDoS > 0)
+        {
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+
+        //failed
+        return;
+    }
+
+    // make sure the vout that was signed is related to the transaction that spawned the Masternode
+    //  - this is expensive, so it's only done once per Masternode
+    if (!obfuScationSigner.IsVinAssociatedWithPubkey(mnb.vin, mnb.pubKeyCollateralAddress)) {
+        LogPrint("masternode","mnb - Got mismatched pubkey and vin\n");
+        Misbehaving(pfrom->GetId(), 33);
+        return;
+    }
+
+    // make sure it's still unspent
+    //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
+    if (mnb.CheckInputsAndAdd(nDoS)) {
+        // use this as a peer
+        addrman.Add(CAddress(mnb.addr), pfrom->addr, 2 * 60 * 60);
+        masternodeSync.AddedMasternodeList(mnb.GetHash());
+    } else {
+        LogPrint("masternode","mnb - Rejected Masternode entry %s\n", mnb.vin.prevout.hash.ToString());
+
+        if (nDoS > 0)
+        {
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
+bool CMasternodeMan::AllowListRequest(CNode* pfrom)
+{
+    //local network
+    bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
+    if (isLocal || NetworkIdFromCommandLine() != CBaseChainParams::MAIN) return true;
+
+    std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
+    if (i != mAskedUsForMasternodeList.end() && GetTime() < (*i).second) return false;
+
+    int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
+    mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+    return true;
+}
+
 void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all Obfuscation/Masternode related functionality
@@ -763,44 +1048,73 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CMasternodeBroadcast mnb;
         vRecv >> mnb;
 
-        if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
-            masternodeSync.AddedMasternodeList(mnb.GetHash());
+        ProcessBroadcast(pfrom, mnb);
+    }
+
+    else if (strCommand == "mnlistget") { //Get Masternode list snapshot, or delta since a list we know
+        uint256 hashBase;
+        vRecv >> hashBase;
+
+        if (!AllowListRequest(pfrom)) {
+            Misbehaving(pfrom->GetId(), 34);
+            LogPrint("masternode","mnlistget - peer already asked me for the list\n");
             return;
         }
-        mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
 
-        int nDoS = 0;
-        if (!mnb.CheckAndUpdate(nDoS)) {
-            if (nDoS > 0)
-            {
-                Misbehaving(pfrom->GetId(), nDoS);
-            }
+        int nCount = PushMasternodeList(pfrom, hashBase);
+        pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, nCount);
+    }
 
-            //failed
+    else if (strCommand == "mnlist") { //Masternode list snapshot or delta, one page of it
+        uint256 hashList;
+        uint256 hashBase;
+        int nPage;
+        int nPages;
+        std::vector<CMasternodeBroadcast> vEntries;
+        vRecv >> hashList >> hashBase >> nPage >> nPages >> vEntries;
+
+        if (vEntries.size() > MASTERNODE_LIST_PAGE_SIZE || nPage < 0 || nPage >= nPages) {
+            Misbehaving(pfrom->GetId(), 20);
             return;
         }
 
-        // make sure the vout that was signed is related to the transaction that spawned the Masternode
-        //  - this is expensive, so it's only done once per Masternode
-        if (!obfuScationSigner.IsVinAssociatedWithPubkey(mnb.vin, mnb.pubKeyCollateralAddress)) {
-            LogPrint("masternode","mnb - Got mismatched pubkey and vin\n");
-            Misbehaving(pfrom->GetId(), 33);
-            return;
+        {
+            LOCK(cs);
+            // Only the peer we sent mnlistget to may answer it, with a delta
+            // against the base we asked for or a full snapshot
+            if (pfrom->GetId() != nListRequestPeer || (!hashBase.IsNull() && hashBase != hashListRequestBase)) {
+                LogPrint("masternode", "mnlist - Unrequested list page from peer %i, ignoring\n", pfrom->GetId());
+                return;
+            }
+            if (hashList != hashListReceiving || nPages != nListPagesExpected) {
+                hashListReceiving = hashList;
+                nListPagesExpected = nPages;
+                setListPagesReceived.clear();
+            }
         }
 
-        // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
-        if (mnb.CheckInputsAndAdd(nDoS)) {
-            // use this as a peer
-            addrman.Add(CAddress(mnb.addr), pfrom->addr, 2 * 60 * 60);
-            masternodeSync.AddedMasternodeList(mnb.GetHash());
-        } else {
-            LogPrint("masternode","mnb - Rejected Masternode entry %s\n", mnb.vin.prevout.hash.ToString());
+        // Recover the signers of the whole page in parallel up front, the
+        // checks below then find them in the signer cache
+        std::vector<std::pair<std::string, std::vector<unsigned char> > > vMessages;
+        BOOST_FOREACH (const CMasternodeBroadcast& mnb, vEntries) {
+            vMessages.push_back(make_pair(mnb.GetStrMessage(), mnb.sig));
+            vMessages.push_back(make_pair(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+        }
+        obfuScationSigner.PrecomputeSigners(vMessages);
 
-            if (nDoS > 0)
-            {
-                Misbehaving(pfrom->GetId(), nDoS);
-            }
+        BOOST_FOREACH (CMasternodeBroadcast& mnb, vEntries)
+            ProcessBroadcast(pfrom, mnb);
+
+        LOCK(cs);
+        if (pfrom->GetId() != nListRequestPeer || hashList != hashListReceiving)
+            return;
+        setListPagesReceived.insert(nPage);
+        if ((int)setListPagesReceived.size() == nListPagesExpected) {
+            // Every page of the list is in, it is safe to ask for deltas against it
+            hashLastReceivedList = hashList;
+            nListRequestPeer = -1;
+            setListPagesReceived.clear();
+            LogPrint("masternode", "mnlist - Received list %s from peer %i\n", hashList.ToString(), pfrom->GetId());
         }
     }
 
@@ -836,21 +1150,10 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vin;
 
         if (vin == CTxIn()) { //only should ask for this once
-            //local network
-            bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
-
-            if (!isLocal && NetworkIdFromCommandLine() == CBaseChainParams::MAIN) {
-                std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
-                if (i != mAskedUsForMasternodeList.end()) {
-                    int64_t t = (*i).second;
-                    if (GetTime() < t) {
-                        Misbehaving(pfrom->GetId(), 34);
-                        LogPrint("masternode","dseg - peer already asked me for the list\n");
-                        return;
-                    }
-                }
-                int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
-                mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+            if (!AllowListRequest(pfrom)) {
+                Misbehaving(pfrom->GetId(), 34);
+                LogPrint("masternode","dseg - peer already asked me for the list\n");
+                return;
             }
         } //else, asking for a specific node which is ok
 
@@ -1176,6 +1479,7 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            RebuildIndex();
             break;
         }
         ++it;
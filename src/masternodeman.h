@@ -16,8 +16,21 @@
 #include "sync.h"
 #include "util.h"
 
+#include <deque>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_LIST_CACHE_SECONDS 60
+#define MASTERNODE_MAINTENANCE_SECONDS 60
+// Recent blocks whose payment votes are looked at again as the tip moves, in case votes came in late
+#define MASTERNODE_LAST_PAID_RESCAN_BLOCKS 10
+
+/** Version of the mnlist snapshot/delta messages this node speaks, announced with sendmnlist */
+static const int MASTERNODE_LIST_VERSION = 1;
+/** Entries per mnlist message, keeps each one far below MAX_PROTOCOL_MESSAGE_LENGTH */
+static const unsigned int MASTERNODE_LIST_PAGE_SIZE = 1000;
+/** Number of past list versions remembered to answer delta requests */
+static const unsigned int MASTERNODE_LIST_HISTORY_SIZE = 30;
 
 using namespace std;
 
@@ -61,6 +74,20 @@ private:
 
     // map to hold all MNs
     std::vector<CMasternode> vMasternodes;
+    // position of every masternode in vMasternodes, by collateral
+    std::map<COutPoint, size_t> mapMasternodeIndex;
+
+    // Height of the last block each payee won with at least 2 votes, over the
+    // nLastPaidWindow blocks up to pindexLastPaid. Extended as the tip moves
+    // forward, rebuilt after a reorg.
+    std::map<CScript, int> mapPayeeLastPaid;
+    const CBlockIndex* pindexLastPaid;
+    int nLastPaidWindow;
+    int nLastPaidFirstHeight;
+    // All masternodes by last payment, longest unpaid first, as of pindexPaymentQueue
+    std::set<std::pair<int64_t, COutPoint> > setPaymentQueue;
+    const CBlockIndex* pindexPaymentQueue;
+    bool fPaymentQueueDirty;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -68,7 +95,45 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // The list as served in mnlist messages: its hash, when it was built,
+    // its entries and those entries already serialized into pages
+    uint256 hashListCache;
+    int64_t nListCacheTime;
+    std::vector<CMasternodeBroadcast> vListCacheEntries;
+    std::vector<CDataStream> vListCachePages;
+    // Recent versions of that list, hash of every entry by collateral,
+    // oldest first. Lets us answer a peer that knows one of them with a delta.
+    std::deque<std::pair<uint256, std::map<COutPoint, uint256> > > dqListHistory;
+    // The mnlistget we are waiting on: the peer we sent it to, the base we
+    // asked for, and the list being received from that peer with the pages
+    // of it applied so far. Pages from anyone else are dropped.
+    NodeId nListRequestPeer;
+    uint256 hashListRequestBase;
+    uint256 hashListReceiving;
+    int nListPagesExpected;
+    std::set<int> setListPagesReceived;
+
+    /// Rebuild the mnlist cache if it is older than MASTERNODES_LIST_CACHE_SECONDS
+    void UpdateListCache();
+    /// Send the list to pnode, as a delta against hashBase if we still know it
+    int PushMasternodeList(CNode* pnode, const uint256& hashBase);
+    /// Process a broadcast received as mnb or as part of mnlist
+    void ProcessBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb);
+    /// Whether pfrom may ask for the full list now (once per MASTERNODES_DSEG_SECONDS on mainnet)
+    bool AllowListRequest(CNode* pfrom);
+    /// Score the masternodes GetMasternodeRank considers, best first
+    bool GetRankedMasternodes(std::vector<pair<int64_t, CTxIn> >& vecMasternodeScores, int64_t nBlockHeight, int minProtocol, bool fOnlyActive);
+    /// Rebuild mapMasternodeIndex after entries were removed from vMasternodes
+    void RebuildIndex();
+    /// Bring mapPayeeLastPaid up to the current tip
+    void UpdateLastPaid();
+    /// Rebuild setPaymentQueue if the tip or the list changed since it was built
+    void UpdatePaymentQueue();
+
 public:
+    // Hash of the last complete mnlist we received, the base of our next delta request
+    uint256 hashLastReceivedList;
+
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
     // Keep track of all pings I've seen
@@ -84,6 +149,7 @@ public:
     {
         LOCK(cs);
         READWRITE(vMasternodes);
+        if (ser_action.ForRead()) RebuildIndex();
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -126,6 +192,9 @@ public:
     /// Find an entry in the masternode list that is next to be paid
     CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
 
+    /// Time of the last recent block paying mn (see CMasternode::GetLastPaid), 0 if none
+    int64_t GetLastPaid(const CMasternode& mn);
+
     /// Find a random entry
     CMasternode* FindRandomNotInVec(std::vector<CTxIn>& vecToExclude, int protocolVersion = -1);
 
@@ -140,6 +209,8 @@ public:
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
+    /// GetMasternodeRank for every ranked masternode at once, by collateral
+    bool GetMasternodeRankIndex(std::map<COutPoint, int>& mapRanksRet, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
     void ProcessMasternodeConnections();
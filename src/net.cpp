@@ -54,6 +54,11 @@ using namespace std;
 namespace {
     const int MAX_OUTBOUND_CONNECTIONS = 30;
 
+    /** Maximum number of queued messages handed to a single sendmsg() call. */
+    const size_t MAX_SEND_IOVECS = 64;
+    /** Maximum number of readiness events collected per epoll_wait() call. */
+    const int MAX_SOCKET_EVENTS = 1024;
+
     struct ListenSocket {
         SOCKET socket;
         bool whitelisted;
@@ -82,8 +87,8 @@ std::string strSubVersion;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
-deque<pair<int64_t, CInv> > vRelayExpiration;
+map<uint256, CTransactionRef> mapRelay;
+deque<pair<int64_t, uint256> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
@@ -461,8 +466,10 @@ void CNode::CloseSocketDisconnect()
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
     TRY_LOCK(cs_vRecvMsg, lockRecv);
-    if (lockRecv)
+    if (lockRecv) {
         vRecvMsg.clear();
+        nRecvMsgSignersPrefetched = 0;
+    }
 }
 
 void CNode::PushVersion()
@@ -714,19 +721,43 @@ void SocketSendData(CNode *pnode)
     std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
+        assert(it->size() > pnode->nSendOffset);
+#ifdef WIN32
         const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Hand as many queued messages to the kernel as fit in one
+        // scatter/gather call, so a burst of small messages costs one syscall.
+        struct iovec iov[MAX_SEND_IOVECS];
+        size_t nIov = 0;
+        for (std::deque<CSerializeData>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itIov, ++nIov) {
+            size_t nOffset = (nIov == 0) ? pnode->nSendOffset : 0;
+            iov[nIov].iov_base = &(*itIov)[nOffset];
+            iov[nIov].iov_len = itIov->size() - nOffset;
+        }
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        ssize_t nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            // Pop every message that went out completely
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                size_t nLeft = it->size() - pnode->nSendOffset;
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
+            }
+            if (pnode->nSendOffset != 0) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -752,6 +783,46 @@ void SocketSendData(CNode *pnode)
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
+/**
+ * Read one chunk of pending data from a peer's socket into its receive queue.
+ * Returns true if the chunk filled the buffer, so more data may be waiting.
+ */
+// requires LOCK(cs_vRecvMsg)
+static bool SocketRecvData(CNode *pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        return nBytes == sizeof(pchBuf);
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
 class CNodeRef {
 public:
     CNodeRef(CNode *pnode) : _pnode(pnode) {
@@ -1027,8 +1098,83 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+static void InactivityCheck(CNode *pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+#ifdef USE_EPOLL
+/** Tag bit marking listen sockets in epoll event data; peers are tagged with their NodeId. */
+static const uint64_t SOCKET_EVENT_LISTEN = 1ULL << 63;
+
+/** Owns the epoll instance used by ThreadSocketHandler. */
+class CSocketEvents
+{
+private:
+    int hEpoll;
+
+public:
+    CSocketEvents() : hEpoll(epoll_create1(EPOLL_CLOEXEC)) {}
+    ~CSocketEvents()
+    {
+        if (hEpoll >= 0)
+            close(hEpoll);
+    }
+
+    bool IsValid() const { return hEpoll >= 0; }
+
+    bool Add(SOCKET hSocket, uint64_t nTag, uint32_t nEvents)
+    {
+        struct epoll_event event = {};
+        event.events = nEvents;
+        event.data.u64 = nTag;
+        return epoll_ctl(hEpoll, EPOLL_CTL_ADD, hSocket, &event) == 0;
+    }
+
+    int Wait(std::vector<struct epoll_event>& vEvents, int nTimeoutMillis)
+    {
+        return epoll_wait(hEpoll, vEvents.data(), vEvents.size(), nTimeoutMillis);
+    }
+};
+#endif
+
 void ThreadSocketHandler()
 {
+#ifdef USE_EPOLL
+    CSocketEvents socketEvents;
+    if (!socketEvents.IsValid())
+        throw std::runtime_error(strprintf("epoll_create1 failed: %s", NetworkErrorString(WSAGetLastError())));
+    for (size_t i = 0; i < vhListenSocket.size(); i++) {
+        // Listen sockets stay level-triggered: one connection is accepted per event
+        if (!socketEvents.Add(vhListenSocket[i].socket, SOCKET_EVENT_LISTEN | i, EPOLLIN))
+            LogPrintf("socket epoll registration error %s\n", NetworkErrorString(WSAGetLastError()));
+    }
+    std::vector<struct epoll_event> vEvents(MAX_SOCKET_EVENTS);
+#endif
+
     unsigned int nPrevNodeCount = 0;
     while (true)
     {
@@ -1095,6 +1241,132 @@ void ThreadSocketHandler()
             uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
+#ifdef USE_EPOLL
+        //
+        // Register new sockets and wait for readiness events
+        //
+        // Peer sockets are registered edge-triggered once, for both directions.
+        // Each event only raises the node's fSocketReadable/fSocketWritable
+        // flag; a flag is cleared again once the socket would block. This
+        // saves rebuilding and scanning the select() fd_sets: the loop below
+        // still visits every peer, but only reads or writes those flagged
+        // ready.
+        // The same flow control as the select() loop applies: a peer with
+        // queued send data is drained before more of its data is received,
+        // and nothing is received while its receive buffer is full.
+        //
+        vector<CNode*> vNodesCopy;
+        bool fMoreWork = false;
+        {
+            LOCK(cs_vNodes);
+            vNodesCopy = vNodes;
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            {
+                pnode->AddRef();
+                if (pnode->fSocketRegistered || pnode->hSocket == INVALID_SOCKET)
+                    continue;
+                if (!socketEvents.Add(pnode->hSocket, pnode->id, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)) {
+                    LogPrintf("socket epoll registration error %s\n", NetworkErrorString(WSAGetLastError()));
+                    pnode->CloseSocketDisconnect();
+                    continue;
+                }
+                pnode->fSocketRegistered = true;
+                pnode->fSocketReadable = true;
+                pnode->fSocketWritable = true;
+                fMoreWork = true;
+            }
+        }
+
+        // frequency to poll for new nodes and drained receive buffers
+        int nEvents = socketEvents.Wait(vEvents, fMoreWork ? 0 : 50);
+        boost::this_thread::interruption_point();
+
+        if (nEvents < 0)
+        {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR)
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            nEvents = 0;
+        }
+
+        std::map<NodeId, uint32_t> mapEvents;
+        for (int i = 0; i < nEvents; i++)
+        {
+            uint64_t nTag = vEvents[i].data.u64;
+            if (nTag & SOCKET_EVENT_LISTEN) {
+                //
+                // Accept new connections
+                //
+                const ListenSocket& hListenSocket = vhListenSocket[nTag & ~SOCKET_EVENT_LISTEN];
+                if (hListenSocket.socket != INVALID_SOCKET)
+                    AcceptConnection(hListenSocket);
+                continue;
+            }
+            mapEvents[(NodeId)nTag] |= vEvents[i].events;
+        }
+
+        //
+        // Service each socket
+        //
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        {
+            boost::this_thread::interruption_point();
+
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            if (!mapEvents.empty()) {
+                std::map<NodeId, uint32_t>::const_iterator it = mapEvents.find(pnode->id);
+                if (it != mapEvents.end()) {
+                    if (it->second & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                        pnode->fSocketReadable = true;
+                    if (it->second & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                        pnode->fSocketWritable = true;
+                }
+            }
+
+            //
+            // Send
+            //
+            bool fSendPending = false;
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    if (pnode->fSocketWritable) {
+                        SocketSendData(pnode);
+                        // wait for the next EPOLLOUT edge if the kernel buffer filled up
+                        pnode->fSocketWritable = pnode->vSendMsg.empty();
+                    }
+                    fSendPending = !pnode->vSendMsg.empty();
+                }
+            }
+
+            //
+            // Receive
+            //
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            if (pnode->fSocketReadable && !fSendPending)
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && (
+                    pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                {
+                    pnode->fSocketReadable = SocketRecvData(pnode);
+                    if (pnode->fSocketReadable)
+                        fMoreWork = true;
+                }
+            }
+
+            InactivityCheck(pnode);
+        }
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                pnode->Release();
+        }
+#else
         //
         // Find which sockets have data to receive
         //
@@ -1211,39 +1483,7 @@ void ThreadSocketHandler()
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
-                {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                    SocketRecvData(pnode);
             }
 
             //
@@ -1258,39 +1498,14 @@ void ThreadSocketHandler()
                     SocketSendData(pnode);
             }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-            }
+            InactivityCheck(pnode);
         }
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->Release();
         }
+#endif
     }
 }
 
@@ -1911,14 +2126,12 @@ instance_of_cnetcleanup;
 
 void RelayTransaction(const CTransaction& tx)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << tx;
-    RelayTransaction(tx, ss);
+    RelayTransaction(MakeTransactionRef(tx));
 }
 
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
+void RelayTransaction(const CTransactionRef& ptx)
 {
+    const CTransaction& tx = *ptx;
     CInv inv(MSG_TX, tx.GetHash());
     {
         LOCK(cs_mapRelay);
@@ -1929,9 +2142,9 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        // Keep the transaction itself; it is usually also in the mempool
+        if (mapRelay.insert(std::make_pair(inv.hash, ptx)).second)
+            vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv.hash));
     }
     LOCK(cs_vNodes);
     BOOST_FOREACH(CNode* pnode, vNodes)
@@ -2167,7 +2380,14 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nStartingHeight = -1;
     fGetAddr = false;
     fRelayTxes = false;
+    fSupportsCompactBlocks = false;
+    nMasternodeListVersion = 0;
+    nRecvMsgSignersPrefetched = 0;
+    fPreferHeaderAndIDs = false;
     fSentAddr = false;
+    fSocketRegistered = false;
+    fSocketReadable = false;
+    fSocketWritable = false;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
     nPingUsecStart = 0;
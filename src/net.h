@@ -13,6 +13,7 @@
 #include "limitedmap.h"
 #include "mruset.h"
 #include "netbase.h"
+#include "primitives/transaction.h"
 #include "protocol.h"
 #include "random.h"
 #include "streams.h"
@@ -149,8 +150,9 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+//! Recently relayed transactions by txid, shared with the mempool
+extern std::map<uint256, CTransactionRef> mapRelay;
+extern std::deque<std::pair<int64_t, uint256> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
@@ -254,6 +256,9 @@ public:
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
+    // Messages at the front of vRecvMsg whose signatures were already
+    // looked at by PrefetchMessageSigners
+    size_t nRecvMsgSignersPrefetched;
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
     int nRecvVersion;
@@ -290,6 +295,20 @@ public:
     // For such cases node should be released manually (preferably right after corresponding code).
     bool fObfuScationMaster;
     bool fSentAddr;
+    // Set from the peer's sendcmpct messages, only ever written by the
+    // message handler thread: whether it understands our compact block
+    // encoding, and whether it wants new blocks pushed as cmpctblock
+    // instead of announced with an inv.
+    bool fSupportsCompactBlocks;
+    bool fPreferHeaderAndIDs;
+    // Set from the peer's sendmnlist message: the mnlist version it
+    // understands, or 0 if it can only be asked for the list with dseg.
+    int nMasternodeListVersion;
+    // Socket readiness as last reported by the epoll socket handler. Only
+    // touched by ThreadSocketHandler.
+    bool fSocketRegistered;
+    bool fSocketReadable;
+    bool fSocketWritable;
     CSemaphoreGrant grantOutbound;
     CCriticalSection cs_filter;
     CBloomFilter* pfilter;
@@ -702,9 +721,8 @@ public:
 
 
 
-class CTransaction;
+void RelayTransaction(const CTransactionRef& ptx);
 void RelayTransaction(const CTransaction& tx);
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll = false);
 void RelayInv(CInv& inv);
 
@@ -6,10 +6,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "obfuscation.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "init.h"
 #include "main.h"
 #include "masternodeman.h"
+#include "scheduler.h"
 #include "script/sign.h"
 #include "swifttx.h"
 #include "ui_interface.h"
@@ -19,6 +21,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
 #include <algorithm>
 #include <boost/assign/list_of.hpp>
@@ -2188,22 +2191,144 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
     return true;
 }
 
-bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+namespace {
+
+/** Upper bound on the number of entries in the message signer cache. */
+static const size_t MAX_MESSAGE_SIGNER_CACHE_SIZE = 100000;
+
+/**
+ * Signers recovered from masternode, budget and SwiftX message signatures,
+ * keyed by a salted hash of the signed hash and the signature. The same
+ * broadcasts, pings and votes arrive from many peers and get checked again
+ * on every relay, and the compact-signature recovery is the expensive part.
+ */
+class CMessageSignerCache
+{
+private:
+    uint256 nonce;
+    std::map<uint256, CKeyID> mapSigners;
+    boost::shared_mutex cs_signercache;
+
+    uint256 GetEntry(const uint256& hash, const std::vector<unsigned char>& vchSig) const
+    {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << nonce << hash << vchSig;
+        return ss.GetHash();
+    }
+
+public:
+    CMessageSignerCache() : nonce(GetRandHash()) {}
+
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet)
+    {
+        uint256 entry = GetEntry(hash, vchSig);
+        boost::shared_lock<boost::shared_mutex> lock(cs_signercache);
+        std::map<uint256, CKeyID>::const_iterator it = mapSigners.find(entry);
+        if (it == mapSigners.end())
+            return false;
+        keyIDRet = it->second;
+        return true;
+    }
+
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        uint256 entry = GetEntry(hash, vchSig);
+        boost::unique_lock<boost::shared_mutex> lock(cs_signercache);
+        if (mapSigners.size() >= MAX_MESSAGE_SIGNER_CACHE_SIZE) {
+            // Evict a random entry, as the script signature cache does
+            std::map<uint256, CKeyID>::iterator it = mapSigners.lower_bound(GetRandHash());
+            if (it == mapSigners.end())
+                it = mapSigners.begin();
+            mapSigners.erase(it);
+        }
+        mapSigners[entry] = keyID;
+    }
+};
+
+CMessageSignerCache signerCache;
+
+/** Recovers the signer of one message signature into signerCache. */
+class CMessageSignerCheck
+{
+private:
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CMessageSignerCheck() {}
+    CMessageSignerCheck(const uint256& hashIn, const std::vector<unsigned char>& vchSigIn) : hash(hashIn), vchSig(vchSigIn) {}
+
+    bool operator()()
+    {
+        CPubKey pubkey;
+        if (pubkey.RecoverCompact(hash, vchSig))
+            signerCache.Set(hash, vchSig, pubkey.GetID());
+        // Bad signatures are reported when the message itself is processed
+        return true;
+    }
+
+    void swap(CMessageSignerCheck& check)
+    {
+        std::swap(hash, check.hash);
+        vchSig.swap(check.vchSig);
+    }
+};
+
+CCheckQueue<CMessageSignerCheck> signercheckqueue(128);
+
+uint256 GetSignedMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
-        errorMessage = _("Error recovering public key.");
-        return false;
+} // anon namespace
+
+void ThreadMessageSignerCheck()
+{
+    RenameThread("vidulum-mnsigch");
+    signercheckqueue.Thread();
+}
+
+bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    uint256 hash = GetSignedMessageHash(strMessage);
+
+    CKeyID keyID;
+    if (!signerCache.Get(hash, vchSig, keyID)) {
+        CPubKey pubkey2;
+        if (!pubkey2.RecoverCompact(hash, vchSig)) {
+            errorMessage = _("Error recovering public key.");
+            return false;
+        }
+        keyID = pubkey2.GetID();
+        signerCache.Set(hash, vchSig, keyID);
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
+
+    return (keyID == pubkey.GetID());
+}
+
+void CObfuScationSigner::PrecomputeSigners(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& vMessages)
+{
+    std::vector<CMessageSignerCheck> vChecks;
+    vChecks.reserve(vMessages.size());
+    for (size_t i = 0; i < vMessages.size(); i++) {
+        uint256 hash = GetSignedMessageHash(vMessages[i].first);
+        CKeyID keyID;
+        if (!signerCache.Get(hash, vMessages[i].second, keyID))
+            vChecks.push_back(CMessageSignerCheck(hash, vMessages[i].second));
+    }
+    if (vChecks.empty())
+        return;
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    CCheckQueueControl<CMessageSignerCheck> control(&signercheckqueue);
+    control.Add(vChecks);
+    control.Wait();
 }
 
 bool CObfuscationQueue::Sign()
@@ -2330,13 +2455,6 @@ void ThreadCheckObfuScationPool()
             // start right after sync is considered to be done
             if (c % MASTERNODE_PING_SECONDS == 1) activeMasternode.ManageStatus();
 
-            if (c % 60 == 0) {
-                mnodeman.CheckAndRemove();
-                mnodeman.ProcessMasternodeConnections();
-                masternodePayments.CleanPaymentList();
-                CleanTransactionLocksList();
-            }
-
             //if(c % MASTERNODES_DUMP_SECONDS == 0) DumpMasternodes();
 
             obfuScationPool.CheckTimeout();
@@ -2347,4 +2465,35 @@ void ThreadCheckObfuScationPool()
             }
         }
     }
-}
\ No newline at end of file
+}
+
+static void MasternodeMaintenance()
+{
+    if (!masternodeSync.IsBlockchainSynced()) return;
+
+    mnodeman.CheckAndRemove();
+    mnodeman.ProcessMasternodeConnections();
+    masternodePayments.CleanPaymentList();
+}
+
+// Runs again when the next lock expires, or after SWIFTTX_LOCK_CHECK_SECONDS
+// so locks cancelled by a conflict are still dropped promptly
+static void SwiftTXLockMaintenance(CScheduler* scheduler)
+{
+    if (masternodeSync.IsBlockchainSynced()) CleanTransactionLocksList();
+
+    int64_t nWait = SWIFTTX_LOCK_CHECK_SECONDS;
+    int64_t nNextExpiration = GetNextLockExpiration();
+    if (nNextExpiration > 0)
+        nWait = std::max((int64_t)1, std::min(nWait, nNextExpiration - GetTime() + 1));
+
+    scheduler->scheduleFromNow(boost::bind(&SwiftTXLockMaintenance, scheduler), nWait);
+}
+
+void StartObfuScationMaintenance(CScheduler& scheduler)
+{
+    if (fLiteMode) return; //disable all Obfuscation/Masternode related functionality
+
+    scheduler.scheduleEvery(&MasternodeMaintenance, MASTERNODE_MAINTENANCE_SECONDS);
+    scheduler.scheduleFromNow(boost::bind(&SwiftTXLockMaintenance, &scheduler), SWIFTTX_LOCK_CHECK_SECONDS);
+}
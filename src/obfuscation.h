@@ -22,6 +22,7 @@ class CMasterNodeVote;
 class CObfuscationQueue;
 class CObfuscationBroadcastTx;
 class CActiveMasternode;
+class CScheduler;
 
 // pool states for mixing
 #define POOL_STATUS_UNKNOWN 0              // waiting for update
@@ -256,10 +257,15 @@ public:
     bool SetKey(std::string strSecret, std::string& errorMessage, CKey& key, CPubKey& pubkey);
     /// Sign the message, returns true if successful
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
-    /// Verify the message, returns true if succcessful
+    /// Verify the message, returns true if succcessful. Signers recovered earlier are looked up, not recovered again.
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Recover the signers of a batch of (message, signature) pairs on the signature check threads, for VerifyMessage to find later
+    void PrecomputeSigners(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& vMessages);
 };
 
+/** Run an instance of the masternode message signature checking thread */
+void ThreadMessageSignerCheck();
+
 /** Used to keep track of current status of Obfuscation pool
  */
 class CObfuscationPool
@@ -513,5 +519,7 @@ public:
 };
 
 void ThreadCheckObfuScationPool();
+/** Schedule masternode list, payment vote and SwiftTX lock upkeep on the scheduler thread */
+void StartObfuScationMaintenance(CScheduler& scheduler);
 
 #endif
\ No newline at end of file
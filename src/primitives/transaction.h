@@ -16,6 +16,7 @@
 #include "consensus/consensus.h"
 
 #include <array>
+#include <memory>
 
 #include <boost/variant.hpp>
 
@@ -798,4 +799,12 @@ struct CMutableTransaction
     }
 };
 
+/**
+ * An immutable transaction that is shared instead of copied: the mempool,
+ * blocks, orphans and relay all hold the same CTransaction.
+ */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "consensus/validation.h"
+#include "dbwrapper.h"
+#include "indexbuilder.h"
 #include "key_io.h"
 #include "main.h"
 #include "primitives/transaction.h"
@@ -149,7 +151,7 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     UniValue deltas(UniValue::VARR);
 
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
         const uint256 txhash = tx.GetHash();
 
         UniValue entry(UniValue::VOBJ);
@@ -249,16 +251,16 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     result.push_back(Pair("finalsaplingroot", block.hashFinalSaplingRoot.GetHex()));
     UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
     {
         if(txDetails)
         {
             UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
+            TxToJSON(*ptx, uint256(), objTx);
             txs.push_back(objTx);
         }
         else
-            txs.push_back(tx.GetHash().GetHex());
+            txs.push_back(ptx->GetHash().GetHex());
     }
     result.push_back(Pair("tx", txs));
     result.push_back(Pair("time", block.GetBlockTime()));
@@ -433,16 +435,16 @@ UniValue getblockdeltas(const UniValue& params, bool fHelp)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
+    std::shared_ptr<const CBlock> pblock;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex))
+    if(!ReadBlockFromDisk(pblock, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    return blockToDeltasJSON(block, pblockindex);
+    return blockToDeltasJSON(*pblock, pblockindex);
 }
 
 UniValue getblockhashes(const UniValue& params, bool fHelp)
@@ -692,24 +694,25 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
+    std::shared_ptr<const CBlock> pblock;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (verbosity == 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
+        if (!ReadRawBlockFromDisk(ssBlock, pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    if(!ReadBlockFromDisk(pblock, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return blockToJSON(*pblock, pblockindex, verbosity >= 2);
 }
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
@@ -750,6 +753,58 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns LevelDB's internal counters for each open database, to help tune -dbprofile.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",            (string) The database (chainstate, blockindex, sporks or mnpayments)\n"
+            "    \"files_per_level\": [n,...],  (array) The number of table files at each level\n"
+            "    \"cache_hits\": n,             (numeric) Block cache lookups that found the block\n"
+            "    \"cache_misses\": n,           (numeric) Block cache lookups that had to read from disk\n"
+            "    \"cache_hit_rate\": x.xxx,     (numeric) The fraction of block cache lookups that hit\n"
+            "    \"write_slowdowns\": n,        (numeric) Writes delayed by 1ms because level 0 is filling up\n"
+            "    \"memtable_waits\": n,         (numeric) Writes blocked until the previous write buffer was compacted\n"
+            "    \"level0_waits\": n,           (numeric) Writes blocked until level 0 was compacted\n"
+            "    \"stall_seconds\": x.xxx,      (numeric) Total time writes spent delayed or blocked\n"
+            "    \"compaction_seconds\": x.xxx, (numeric) Total time spent compacting\n"
+            "    \"compaction_read_bytes\": n,  (numeric) Bytes read by compactions\n"
+            "    \"compaction_write_bytes\": n  (numeric) Bytes written by compactions\n"
+            "  },...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH(const CDBStats& stats, GetDBStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.strName));
+        UniValue levels(UniValue::VARR);
+        BOOST_FOREACH(int nFiles, stats.vFilesPerLevel)
+            levels.push_back(nFiles);
+        obj.push_back(Pair("files_per_level", levels));
+        uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+        obj.push_back(Pair("cache_hits", (uint64_t)stats.nCacheHits));
+        obj.push_back(Pair("cache_misses", (uint64_t)stats.nCacheMisses));
+        obj.push_back(Pair("cache_hit_rate", nLookups ? (double)stats.nCacheHits / nLookups : 0.0));
+        obj.push_back(Pair("write_slowdowns", stats.nWriteSlowdowns));
+        obj.push_back(Pair("memtable_waits", stats.nMemtableWaits));
+        obj.push_back(Pair("level0_waits", stats.nLevel0Waits));
+        obj.push_back(Pair("stall_seconds", stats.nStallMicros / 1e6));
+        obj.push_back(Pair("compaction_seconds", stats.nCompactionMicros / 1e6));
+        obj.push_back(Pair("compaction_read_bytes", stats.nCompactionBytesRead));
+        obj.push_back(Pair("compaction_write_bytes", stats.nCompactionBytesWritten));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -961,6 +1016,11 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"consensus\": {               (object) branch IDs of the current and upcoming consensus rules\n"
             "     \"chaintip\": \"xxxxxxxx\",   (string) branch ID used to validate the current chain tip\n"
             "     \"nextblock\": \"xxxxxxxx\"   (string) branch ID that the next block will be validated under\n"
+            "  },\n"
+            "  \"indexbuild\": {              (object, only while building) indexes being built in the background\n"
+            "     \"indexes\": [\"xxxx\", ...], (array) names of the indexes\n"
+            "     \"height\": xxxxxx,         (numeric) height of the last block indexed\n"
+            "     \"progress\": xxxx          (numeric) fraction of the active chain indexed [0..1]\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -1008,6 +1068,19 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     consensus.push_back(Pair("nextblock", HexInt(CurrentEpochBranchId(tip->nHeight + 1, consensusParams))));
     obj.push_back(Pair("consensus", consensus));
 
+    std::vector<std::string> vIndexes;
+    int nIndexHeight;
+    if (GetIndexBuildProgress(vIndexes, nIndexHeight)) {
+        UniValue indexbuild(UniValue::VOBJ);
+        UniValue indexes(UniValue::VARR);
+        BOOST_FOREACH(const std::string& strIndex, vIndexes)
+            indexes.push_back(strIndex);
+        indexbuild.push_back(Pair("indexes", indexes));
+        indexbuild.push_back(Pair("height", nIndexHeight));
+        indexbuild.push_back(Pair("progress", tip->nHeight > 0 ? std::min(1.0, (double)nIndexHeight / tip->nHeight) : 1.0));
+        obj.push_back(Pair("indexbuild", indexbuild));
+    }
+
     if (fPruneMode)
     {
         CBlockIndex *block = chainActive.Tip();
@@ -1130,6 +1203,9 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
     return ret;
 }
@@ -1145,6 +1221,8 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -1242,6 +1320,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
@@ -676,7 +676,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     UniValue transactions(UniValue::VARR);
     map<uint256, int64_t> setTxIndex;
     int i = 0;
-    BOOST_FOREACH (const CTransaction& tx, pblock->vtx) {
+    BOOST_FOREACH (const CTransactionRef& ptx, pblock->vtx) {
+        const CTransaction& tx = *ptx;
         uint256 txHash = tx.GetHash();
         setTxIndex[txHash] = i++;
 
@@ -703,7 +704,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
         if (tx.IsCoinBase()) {
             // Show Vidulum Rewards System if it is required
-            if (pblock->vtx[0].vout.size() > 1 && (nHeight >= Params().GetConsensus().vUpgrades[Consensus::UPGRADE_OVERWINTER].nActivationHeight)) {
+            if (pblock->vtx[0]->vout.size() > 1 && (nHeight >= Params().GetConsensus().vUpgrades[Consensus::UPGRADE_OVERWINTER].nActivationHeight)) {
                 // Correct this if GetBlockTemplate changes the order
                 entry.push_back(Pair("vrewardsystem", (int64_t)tx.vout[1].nValue));
             }
@@ -739,7 +740,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         result.push_back(Pair("coinbasetxn", txCoinbase));
     } else {
         result.push_back(Pair("coinbaseaux", aux));
-        result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].vout[0].nValue));
+        result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue));
     }
     result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
     result.push_back(Pair("target", hashTarget.GetHex()));
@@ -759,7 +760,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         ExtractDestination(pblock->payee, address1);
 
         result.push_back(Pair("payee", EncodeDestination(address1)));
-        CAmount val = pblock->vtx[0].vout[pblock->vtx[0].vout.size() - 1].nValue;
+        CAmount val = pblock->vtx[0]->vout[pblock->vtx[0]->vout.size() - 1].nValue;
         result.push_back(Pair("payee_amount", (int64_t)val));
     } else {
         result.push_back(Pair("payee", ""));
@@ -798,6 +799,8 @@ protected:
         found = true;
         state = stateIn;
     };
+    // submitblock reads the result right after ProcessNewBlock returns
+    virtual bool IsSynchronous() const { return true; }
 };
 
 UniValue submitblock(const UniValue& params, bool fHelp)
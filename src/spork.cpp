@@ -14,6 +14,9 @@
 #include "sporkdb.h"
 #include "util.h"
 #include "consensus/validation.h"
+
+#include <atomic>
+
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -24,9 +27,59 @@ class CSporkManager;
 
 CSporkManager sporkManager;
 
+/** Guards mapSporks and mapSporksActive */
+CCriticalSection cs_mapSporks;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 
+namespace {
+
+/**
+ * The value of every spork ID, indexed by nSporkID - SPORK_START. Holds the
+ * default until a signed value is accepted, -1 for unused IDs. Lookups sit in
+ * per-masternode loops and block validation, so they are a single atomic
+ * load instead of a map search under a lock.
+ */
+std::atomic<int64_t> sporkValues[SPORK_END - SPORK_START + 1];
+
+int64_t GetSporkDefault(int nSporkID)
+{
+    switch (nSporkID) {
+    case SPORK_2_SWIFTTX: return SPORK_2_SWIFTTX_DEFAULT;
+    case SPORK_3_SWIFTTX_BLOCK_FILTERING: return SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
+    case SPORK_5_MAX_VALUE: return SPORK_5_MAX_VALUE_DEFAULT;
+    case SPORK_7_MASTERNODE_SCANNING: return SPORK_7_MASTERNODE_SCANNING_DEFAULT;
+    case SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT: return SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
+    case SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT: return SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
+    case SPORK_10_MASTERNODE_PAY_UPDATED_NODES: return SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
+    case SPORK_11_LOCK_INVALID_UTXO: return SPORK_11_LOCK_INVALID_UTXO_DEFAULT;
+    case SPORK_13_ENABLE_SUPERBLOCKS: return SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
+    }
+    return -1;
+}
+
+class CSporkValuesInit
+{
+public:
+    CSporkValuesInit()
+    {
+        for (int i = SPORK_START; i <= SPORK_END; ++i)
+            sporkValues[i - SPORK_START].store(GetSporkDefault(i), std::memory_order_relaxed);
+    }
+} instance_of_csporkvaluesinit;
+
+/** Store spork as the active message for its ID and publish its value. Requires cs_mapSporks. */
+void SetActiveSpork(const CSporkMessage& spork)
+{
+    AssertLockHeld(cs_mapSporks);
+    assert(spork.nSporkID >= SPORK_START && spork.nSporkID <= SPORK_END);
+    mapSporks[spork.GetHash()] = spork;
+    mapSporksActive[spork.nSporkID] = spork;
+    sporkValues[spork.nSporkID - SPORK_START].store(spork.nValue, std::memory_order_release);
+}
+
+} // anon namespace
+
 // Vidulum: on startup load spork values from previous session if they exist in the sporkDB
 void LoadSporksFromDB()
 {
@@ -43,8 +96,10 @@ void LoadSporksFromDB()
         }
 
         // add spork to memory
-        mapSporks[spork.GetHash()] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        {
+            LOCK(cs_mapSporks);
+            SetActiveSpork(spork);
+        }
         std::time_t result = spork.nValue;
         // If SPORK Value is greater than 1,000,000 assume it's actually a Date and then convert to a more readable format
         if (spork.nValue > 1000000) {
@@ -75,12 +130,16 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         if (strSpork == "Unknown") return;
 
         uint256 hash = spork.GetHash();
-        if (mapSporksActive.count(spork.nSporkID)) {
-            if (mapSporksActive[spork.nSporkID].nTimeSigned >= spork.nTimeSigned) {
-                if (fDebug) LogPrintf("spork - seen %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
-                return;
-            } else {
-                if (fDebug) LogPrintf("spork - got updated spork %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
+        {
+            LOCK(cs_mapSporks);
+            std::map<int, CSporkMessage>::const_iterator it = mapSporksActive.find(spork.nSporkID);
+            if (it != mapSporksActive.end()) {
+                if (it->second.nTimeSigned >= spork.nTimeSigned) {
+                    if (fDebug) LogPrintf("spork - seen %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
+                    return;
+                } else {
+                    if (fDebug) LogPrintf("spork - got updated spork %s block %d \n", hash.ToString(), chainActive.Tip()->nHeight);
+                }
             }
         }
 
@@ -92,14 +151,21 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
             return;
         }
 
-        mapSporks[hash] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        {
+            LOCK(cs_mapSporks);
+            // Another peer may have delivered a newer one while we checked the signature
+            std::map<int, CSporkMessage>::const_iterator it = mapSporksActive.find(spork.nSporkID);
+            if (it != mapSporksActive.end() && it->second.nTimeSigned >= spork.nTimeSigned)
+                return;
+            SetActiveSpork(spork);
+        }
         sporkManager.Relay(spork);
 
         // Vidulum: add to spork database.
         pSporkDB->WriteSpork(spork.nSporkID, spork);
     }
     if (strCommand == "getsporks") {
+        LOCK(cs_mapSporks);
         std::map<int, CSporkMessage>::iterator it = mapSporksActive.begin();
 
         while (it != mapSporksActive.end()) {
@@ -113,24 +179,13 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 // grab the value of the spork on the network, or the default
 int64_t GetSporkValue(int nSporkID)
 {
-    int64_t r = -1;
-
-    if (mapSporksActive.count(nSporkID)) {
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if (nSporkID == SPORK_2_SWIFTTX) r = SPORK_2_SWIFTTX_DEFAULT;
-        if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) r = SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
-        if (nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if (nSporkID == SPORK_7_MASTERNODE_SCANNING) r = SPORK_7_MASTERNODE_SCANNING_DEFAULT;
-        if (nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) r = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) r = SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) r = SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
-        if (nSporkID == SPORK_11_LOCK_INVALID_UTXO) r = SPORK_11_LOCK_INVALID_UTXO_DEFAULT;
-        if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-
-        if (r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+    if (nSporkID < SPORK_START || nSporkID > SPORK_END) {
+        LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+        return -1;
     }
 
+    int64_t r = sporkValues[nSporkID - SPORK_START].load(std::memory_order_acquire);
+    if (r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
     return r;
 }
 
@@ -222,8 +277,8 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
 
     if (Sign(msg)) {
         Relay(msg);
-        mapSporks[msg.GetHash()] = msg;
-        mapSporksActive[nSporkID] = msg;
+        LOCK(cs_mapSporks);
+        SetActiveSpork(msg);
         return true;
     }
 
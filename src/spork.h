@@ -54,12 +54,14 @@ using namespace boost;
 class CSporkMessage;
 class CSporkManager;
 
+extern CCriticalSection cs_mapSporks;
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
 extern CSporkManager sporkManager;
 
 void LoadSporksFromDB();
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+/** Current value of a spork, or -1 for an unknown ID. Never locks, safe from any thread. */
 int64_t GetSporkValue(int nSporkID);
 bool IsSporkActive(int nSporkID);
 void ReprocessBlocks(int nBlocks);
@@ -11,11 +11,13 @@
 #include "net.h"
 #include "obfuscation.h"
 #include "protocol.h"
+#include "random.h"
 #include "spork.h"
 #include "sync.h"
 #include "util.h"
 #include "consensus/validation.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
 
 using namespace std;
 using namespace boost;
@@ -24,9 +26,127 @@ std::map<uint256, CTransaction> mapTxLockReq;
 std::map<uint256, CTransaction> mapTxLockReqRejected;
 std::map<uint256, CConsensusVote> mapTxLockVote;
 std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
 int nCompleteTXLocks;
+CCriticalSection cs_swifttx;
+
+namespace {
+
+/** Salted so peers can't pick outpoints that pile up in one bucket */
+class CLockedInputHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CLockedInputHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const COutPoint& out) const
+    {
+        return SipHashUint256Extra(k0, k1, out.hash, out.n);
+    }
+};
+
+/** Locked input -> the transaction holding the lock. Checked by AcceptToMemoryPool and CheckBlock */
+CCriticalSection cs_lockedInputs;
+boost::unordered_map<COutPoint, uint256, CLockedInputHasher> mapLockedInputs;
+
+/** mapTxLocks ordered by nExpiration, so cleanup only looks at what has expired */
+std::set<std::pair<int64_t, uint256> > setLockExpiry;
+
+/** Masternode ranks used for a lock's block height, rebuilt at most every SWIFTTX_RANK_CACHE_SECONDS */
+struct CSwiftTXRanks {
+    int64_t nTimeBuilt;
+    std::map<COutPoint, int> mapRanks;
+};
+CCriticalSection cs_rankCache;
+std::map<int, CSwiftTXRanks> mapRankCache;
+
+void LockInputs(const CTransaction& tx, const uint256& txHash)
+{
+    LOCK(cs_lockedInputs);
+    BOOST_FOREACH (const CTxIn& in, tx.vin)
+        mapLockedInputs.insert(make_pair(in.prevout, txHash));
+}
+
+void UnlockInputs(const CTransaction& tx)
+{
+    LOCK(cs_lockedInputs);
+    BOOST_FOREACH (const CTxIn& in, tx.vin)
+        mapLockedInputs.erase(in.prevout);
+}
+
+void SetLockExpiration(CTransactionLock& txLock, int64_t nExpiration)
+{
+    AssertLockHeld(cs_swifttx);
+    setLockExpiry.erase(make_pair((int64_t)txLock.nExpiration, txLock.txHash));
+    txLock.nExpiration = nExpiration;
+    setLockExpiry.insert(make_pair(nExpiration, txLock.txHash));
+}
+
+void AddNewLock(const uint256& txHash, int nBlockHeight)
+{
+    AssertLockHeld(cs_swifttx);
+    CTransactionLock newLock;
+    newLock.nBlockHeight = nBlockHeight;
+    newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
+    newLock.nTimeout = GetTime() + (60 * 5);
+    newLock.txHash = txHash;
+    mapTxLocks.insert(make_pair(txHash, newLock));
+    setLockExpiry.insert(make_pair((int64_t)newLock.nExpiration, txHash));
+}
+
+} // anon namespace
+
+bool GetConflictingLock(const CTransaction& tx, uint256& hashLockRet)
+{
+    LOCK(cs_lockedInputs);
+    if (mapLockedInputs.empty()) return false;
+
+    const uint256& hash = tx.GetHash();
+    BOOST_FOREACH (const CTxIn& in, tx.vin) {
+        boost::unordered_map<COutPoint, uint256, CLockedInputHasher>::const_iterator it = mapLockedInputs.find(in.prevout);
+        if (it != mapLockedInputs.end() && it->second != hash) {
+            hashLockRet = it->second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int GetSwiftTXRank(const CTxIn& vin, int nBlockHeight)
+{
+    LOCK(cs_rankCache);
+    int64_t nNow = GetTime();
+
+    std::map<int, CSwiftTXRanks>::iterator it = mapRankCache.find(nBlockHeight);
+    if (it != mapRankCache.end() && nNow - it->second.nTimeBuilt < SWIFTTX_RANK_CACHE_SECONDS) {
+        std::map<COutPoint, int>::const_iterator itRank = it->second.mapRanks.find(vin.prevout);
+        if (itRank != it->second.mapRanks.end()) return itRank->second;
+        // an unknown masternode may have shown up since, but don't rescore for every such vote
+        if (nNow - it->second.nTimeBuilt < SWIFTTX_RANK_CACHE_MISS_SECONDS) return -1;
+    }
+
+    CSwiftTXRanks ranks;
+    if (!mnodeman.GetMasternodeRankIndex(ranks.mapRanks, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION)) return -1;
+    ranks.nTimeBuilt = nNow;
+
+    // drop heights nobody has voted on for a while
+    std::map<int, CSwiftTXRanks>::iterator itOld = mapRankCache.begin();
+    while (itOld != mapRankCache.end()) {
+        if (nNow - itOld->second.nTimeBuilt >= SWIFTTX_RANK_CACHE_SECONDS)
+            mapRankCache.erase(itOld++);
+        else
+            ++itOld;
+    }
+
+    std::map<COutPoint, int>::const_iterator itRank = ranks.mapRanks.find(vin.prevout);
+    int nRank = itRank != ranks.mapRanks.end() ? itRank->second : -1;
+    mapRankCache[nBlockHeight].nTimeBuilt = ranks.nTimeBuilt;
+    mapRankCache[nBlockHeight].mapRanks.swap(ranks.mapRanks);
+    return nRank;
+}
 
 //txlock - Locks transaction
 //
@@ -50,8 +170,10 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
-            return;
+        {
+            LOCK(cs_swifttx);
+            if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash()))
+                return;
         }
 
         if (!IsIXTXValid(tx)) {
@@ -82,7 +204,10 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            {
+                LOCK(cs_swifttx);
+                mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            }
 
             LogPrintf("ProcessMessageSwiftTX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -91,7 +216,10 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            {
+                LOCK(cs_swifttx);
+                mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            }
 
             // can we get the conflicting transaction as proof?
 
@@ -99,24 +227,25 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
                 tx.GetHash().ToString().c_str());
 
-            BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                if (!mapLockedInputs.count(in.prevout)) {
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
-                }
-            }
+            LockInputs(tx, tx.GetHash());
 
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()) {
-                //we only care if we have a complete tx lock
-                if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-                    if (!CheckForConflictingLocks(tx)) {
-                        LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
-                    }
+            int nSignatures = 0;
+            {
+                LOCK(cs_swifttx);
+                std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
+                if (i != mapTxLocks.end())
+                    nSignatures = (*i).second.CountSignatures();
+            }
+            //we only care if we have a complete tx lock
+            if (nSignatures >= SWIFTTX_SIGNATURES_REQUIRED) {
+                if (!CheckForConflictingLocks(tx)) {
+                    LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
+
+                    //reprocess the last 15 blocks
+                    ReprocessBlocks(15);
+                    LOCK(cs_swifttx);
+                    mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
                 }
             }
 
@@ -130,11 +259,13 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
-            return;
-        }
+        {
+            LOCK(cs_swifttx);
+            if (mapTxLockVote.count(ctx.GetHash()))
+                return;
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+            mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+        }
 
         if (ProcessConsensusVote(pfrom, ctx)) {
             //Spam/Dos protection
@@ -143,19 +274,22 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 This tracks those messages and allows it at the same rate of the rest of the network, if
                 a peer violates it, it will simply be ignored
             */
-            if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
-                if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
+            {
+                LOCK(cs_swifttx);
+                if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
+                    if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    }
 
-                if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
-                    LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
-                        ctx.vinMasternode.ToString().c_str(),
-                        ctx.txHash.ToString().c_str());
-                    return;
-                } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
+                        LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
+                            ctx.vinMasternode.ToString().c_str(),
+                            ctx.txHash.ToString().c_str());
+                        return;
+                    } else {
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    }
                 }
             }
             RelayInv(inv);
@@ -231,15 +365,11 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
 
+    LOCK(cs_swifttx);
     if (!mapTxLocks.count(tx.GetHash())) {
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
 
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
+        AddNewLock(tx.GetHash(), nBlockHeight);
     } else {
         mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
         LogPrint("swiftx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
@@ -254,7 +384,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetSwiftTXRank(activeMasternode.vin, nBlockHeight);
 
     if (n == -1) {
         LogPrint("swiftx", "SwiftX::DoConsensusVote - Unknown Masternode\n");
@@ -284,7 +414,10 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    {
+        LOCK(cs_swifttx);
+        mapTxLockVote[ctx.GetHash()] = ctx;
+    }
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
@@ -293,7 +426,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetSwiftTXRank(ctx.vinMasternode, ctx.nBlockHeight);
 
     CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
     if (pmn != NULL)
@@ -318,68 +451,69 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)) {
-        LogPrintf("SwiftX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else
-        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
-
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()) {
+    int nSignatures;
+    {
+        LOCK(cs_swifttx);
+        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
+        if (i == mapTxLocks.end()) {
+            LogPrintf("SwiftX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+
+            AddNewLock(ctx.txHash, 0);
+            i = mapTxLocks.find(ctx.txHash);
+        } else
+            LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
+
+        //compile consessus vote
         (*i).second.AddSignature(ctx);
+        nSignatures = (*i).second.CountSignatures();
+    }
 
 #ifdef ENABLE_WALLET
-        if (pwalletMain) {
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if (pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
+    if (pwalletMain) {
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if (pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
-        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+    LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
 
-        if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-            LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+    if (nSignatures >= SWIFTTX_SIGNATURES_REQUIRED) {
+        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if (!CheckForConflictingLocks(tx)) {
+        // The wallet and block reprocessing below take other locks, so work on copies
+        CTransaction tx;
+        bool fHaveRequest, fRejected;
+        {
+            LOCK(cs_swifttx);
+            std::map<uint256, CTransaction>::const_iterator itReq = mapTxLockReq.find(ctx.txHash);
+            fHaveRequest = itReq != mapTxLockReq.end();
+            if (fHaveRequest)
+                tx = itReq->second;
+            fRejected = mapTxLockReqRejected.count(ctx.txHash);
+        }
+        if (!CheckForConflictingLocks(tx)) {
 #ifdef ENABLE_WALLET
-                if (pwalletMain) {
-                    if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
-                        nCompleteTXLocks++;
-                    }
+            if (pwalletMain) {
+                if (pwalletMain->UpdatedTransaction(ctx.txHash)) {
+                    nCompleteTXLocks++;
                 }
+            }
 #endif
 
-                if (mapTxLockReq.count(ctx.txHash)) {
-                    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                        if (!mapLockedInputs.count(in.prevout)) {
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
-                }
+            if (fHaveRequest)
+                LockInputs(tx, ctx.txHash);
 
-                // resolve conflicts
+            // resolve conflicts
 
-                //if this tx lock was rejected, we need to remove the conflicting blocks
-                if (mapTxLockReqRejected.count((*i).second.txHash)) {
-                    //reprocess the last 15 blocks
-                    ReprocessBlocks(15);
-                }
+            //if this tx lock was rejected, we need to remove the conflicting blocks
+            if (fRejected) {
+                //reprocess the last 15 blocks
+                ReprocessBlocks(15);
             }
         }
-        return true;
     }
-
-
-    return false;
+    return true;
 }
 
 bool CheckForConflictingLocks(CTransaction& tx)
@@ -391,22 +525,27 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
-        }
-    }
+    uint256 hashConflict;
+    if (!GetConflictingLock(tx, hashConflict)) return false;
+
+    LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), hashConflict.ToString().c_str());
+    LOCK(cs_swifttx);
+    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(tx.GetHash());
+    if (it != mapTxLocks.end()) SetLockExpiration(it->second, GetTime());
+    it = mapTxLocks.find(hashConflict);
+    if (it != mapTxLocks.end()) SetLockExpiration(it->second, GetTime());
+    return true;
+}
 
-    return false;
+int64_t GetNextLockExpiration()
+{
+    LOCK(cs_swifttx);
+    return setLockExpiry.empty() ? 0 : setLockExpiry.begin()->first;
 }
 
 int64_t GetAverageVoteTime()
 {
+    AssertLockHeld(cs_swifttx);
     std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
     int64_t total = 0;
     int64_t count = 0;
@@ -424,29 +563,31 @@ void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    int64_t nNow = GetTime();
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    LOCK(cs_swifttx);
+    //keep them for an hour
+    while (!setLockExpiry.empty() && setLockExpiry.begin()->first < nNow) {
+        uint256 txHash = setLockExpiry.begin()->second;
+        setLockExpiry.erase(setLockExpiry.begin());
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+        std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(txHash);
+        if (it == mapTxLocks.end()) continue;
 
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+        LogPrintf("Removing old transaction lock %s\n", txHash.ToString().c_str());
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+        std::map<uint256, CTransaction>::iterator itReq = mapTxLockReq.find(txHash);
+        if (itReq != mapTxLockReq.end()) {
+            UnlockInputs(itReq->second);
 
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
+            mapTxLockReq.erase(itReq);
+            mapTxLockReqRejected.erase(txHash);
 
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
+            BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
+                mapTxLockVote.erase(v.GetHash());
         }
+
+        mapTxLocks.erase(it);
     }
 }
 
@@ -457,10 +598,15 @@ uint256 CConsensusVote::GetHash() const
 }
 
 
+std::string CConsensusVote::GetStrMessage() const
+{
+    return txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
     CMasternode* pmn = mnodeman.Find(vinMasternode);
@@ -484,7 +630,7 @@ bool CConsensusVote::Sign()
 
     CKey key2;
     CPubKey pubkey2;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("signing strMessage %s \n", strMessage.c_str());
     //LogPrintf("signing privkey %s \n", strMasterNodePrivKey.c_str());
 
@@ -510,7 +656,7 @@ bool CConsensusVote::Sign()
 bool CTransactionLock::SignaturesValid()
 {
     BOOST_FOREACH (CConsensusVote vote, vecConsensusVotes) {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+        int n = GetSwiftTXRank(vote.vinMasternode, vote.nBlockHeight);
 
         if (n == -1) {
             LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
@@ -28,6 +28,12 @@
 #define SWIFTTX_SIGNATURES_REQUIRED 6
 #define SWIFTTX_SIGNATURES_TOTAL 10
 
+/** How long masternode ranks for a lock height are reused, and how soon an unknown voter may force a rescore */
+#define SWIFTTX_RANK_CACHE_SECONDS 60
+#define SWIFTTX_RANK_CACHE_MISS_SECONDS 10
+/** Longest wait between lock expiry checks */
+#define SWIFTTX_LOCK_CHECK_SECONDS 60
+
 using namespace std;
 using namespace boost;
 
@@ -37,11 +43,13 @@ class CTransactionLock;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
 
+/** Guards mapTxLockReq, mapTxLockReqRejected, mapTxLockVote, mapTxLocks and the lock expiry
+ *  queue. Taken after cs_main and cs_wallet, and never held while taking either */
+extern CCriticalSection cs_swifttx;
 extern map<uint256, CTransaction> mapTxLockReq;
 extern map<uint256, CTransaction> mapTxLockReqRejected;
 extern map<uint256, CConsensusVote> mapTxLockVote;
 extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
 extern int nCompleteTXLocks;
 
 
@@ -52,6 +60,12 @@ bool IsIXTXValid(const CTransaction& txCollateral);
 // if two conflicting locks are approved by the network, they will cancel out
 bool CheckForConflictingLocks(CTransaction& tx);
 
+// whether an input of tx is locked by another transaction, returned in hashLockRet
+bool GetConflictingLock(const CTransaction& tx, uint256& hashLockRet);
+
+// rank of a masternode for the lock block height, -1 if unknown
+int GetSwiftTXRank(const CTxIn& vin, int nBlockHeight);
+
 void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
 //check if we need to vote on this transaction
@@ -63,6 +77,9 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
 // keep transaction locks in memory for an hour
 void CleanTransactionLocksList();
 
+// when the next transaction lock expires, 0 if there are none
+int64_t GetNextLockExpiration();
+
 int64_t GetAverageVoteTime();
 
 class CConsensusVote
@@ -77,6 +94,8 @@ public:
 
     bool SignatureValid();
     bool Sign();
+    /// The message vchMasterNodeSignature signs
+    std::string GetStrMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -0,0 +1,135 @@
+// Copyright (c) 2018 The Vidulum developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+#include "chainparams.h"
+#include "core_memusage.h"
+#include "main.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstore_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce)
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nNonce;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.nVersion = 4;
+    block.nTime = nNonce;
+    return std::make_shared<const CBlock>(block);
+}
+
+BOOST_AUTO_TEST_CASE(memory_reader)
+{
+    std::shared_ptr<const CBlock> pblock = MakeBlock(1);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << *pblock;
+
+    CMemoryReader reader(&ss[0], &ss[0] + ss.size(), SER_DISK, CLIENT_VERSION);
+    CBlock block;
+    reader >> block;
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK(block.GetHash() == pblock->GetHash());
+
+    // Reading past the end throws instead of running off the buffer
+    CMemoryReader truncated(&ss[0], &ss[0] + ss.size() - 1, SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK_THROW(truncated >> block, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(block_cache_lru)
+{
+    std::vector<std::shared_ptr<const CBlock> > blocks;
+    for (uint32_t i = 0; i < 3; i++)
+        blocks.push_back(MakeBlock(i));
+    size_t nBlockUsage = sizeof(CBlock) + RecursiveDynamicUsage(*blocks[0]);
+
+    // Room for two blocks
+    CBlockCache cache(nBlockUsage * 2);
+    cache.Insert(blocks[0]->GetHash(), blocks[0]);
+    cache.Insert(blocks[1]->GetHash(), blocks[1]);
+    BOOST_CHECK_EQUAL(cache.DynamicUsage(), nBlockUsage * 2);
+
+    // Touching block 0 makes block 1 the least recently used
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+    cache.Insert(blocks[2]->GetHash(), blocks[2]);
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+    BOOST_CHECK(!cache.Get(blocks[1]->GetHash()));
+    BOOST_CHECK(cache.Get(blocks[2]->GetHash()) == blocks[2]);
+
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.DynamicUsage(), 0U);
+    BOOST_CHECK(!cache.Get(blocks[2]->GetHash()));
+}
+
+#ifndef WIN32
+static CBlock ReadMapped(const CMappedBlock& mapped)
+{
+    CMemoryReader reader(mapped.pbegin, mapped.pend, SER_DISK, CLIENT_VERSION);
+    CBlock block;
+    reader >> block;
+    BOOST_CHECK(reader.empty());
+    return block;
+}
+
+BOOST_FIXTURE_TEST_CASE(block_file_map, TestingSetup)
+{
+    // Find() always fails where block files are not mapped
+    if (sizeof(void*) < 8)
+        return;
+
+    // A file number of its own, away from the files the setup wrote
+    const CMessageHeader::MessageStartChars& messageStart = Params().MessageStart();
+    CBlockFileMap filemap;
+    CBlock block1 = *MakeBlock(1);
+    CDiskBlockPos pos1(1000, 0);
+    BOOST_CHECK(WriteBlockToDisk(block1, pos1, messageStart));
+
+    CMappedBlock mapped1;
+    BOOST_CHECK(filemap.Find(pos1, messageStart, mapped1));
+    BOOST_CHECK(ReadMapped(mapped1).GetHash() == block1.GetHash());
+
+    // Append a block past the end of the current map, finding it maps the file again
+    CBlock block2 = *MakeBlock(2);
+    CDiskBlockPos pos2(1000, pos1.nPos + ::GetSerializeSize(block1, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(WriteBlockToDisk(block2, pos2, messageStart));
+    BOOST_CHECK(pos2.nPos > mapped1.file->size);
+
+    CMappedBlock mapped2;
+    BOOST_CHECK(filemap.Find(pos2, messageStart, mapped2));
+    BOOST_CHECK(mapped2.file != mapped1.file);
+    BOOST_CHECK(ReadMapped(mapped2).GetHash() == block2.GetHash());
+    // The reader of the older, shorter map still holds it
+    BOOST_CHECK(ReadMapped(mapped1).GetHash() == block1.GetHash());
+
+    // A position that is not the start of a block is not found
+    CMappedBlock mappedBad;
+    BOOST_CHECK(!filemap.Find(CDiskBlockPos(1000, pos2.nPos + 1), messageStart, mappedBad));
+
+    // After Unmap, held maps stay valid and reading the file still works
+    filemap.Unmap(1000);
+    BOOST_CHECK(ReadMapped(mapped2).GetHash() == block2.GetHash());
+    CAutoFile filein(OpenBlockFile(pos2, true), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(!filein.IsNull());
+    CBlock block;
+    filein >> block;
+    BOOST_CHECK(block.GetHash() == block2.GetHash());
+    filein.fclose();
+
+    // and the file is mapped again on the next Find
+    CMappedBlock mapped3;
+    BOOST_CHECK(filemap.Find(pos1, messageStart, mapped3));
+    BOOST_CHECK(mapped3.file != mapped2.file);
+    BOOST_CHECK(ReadMapped(mapped3).GetHash() == block1.GetHash());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -231,4 +231,127 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 
 
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profile)
+{
+    mapMultiArgs["-dbprofile"].clear();
+    mapMultiArgs["-dbprofile"].push_back("sporks:maxopenfiles=100");
+    mapMultiArgs["-dbprofile"].push_back("sporks:bloombits=0");
+    mapMultiArgs["-dbprofile"].push_back("sporks:writebuffer=2");
+    mapMultiArgs["-dbprofile"].push_back("chainstate:blocksize=8192");
+    mapMultiArgs["-dbprofile"].push_back("sporks:subcompactions=2");
+
+    std::string strError;
+    BOOST_CHECK(CheckDBProfileArgs(strError));
+    BOOST_CHECK_EQUAL(GetDBProfileExtraFiles(), 100 - DEFAULT_DB_MAX_OPEN_FILES);
+
+    CDBProfile profile("sporks", 1 << 20);
+    ApplyDBProfileArgs(profile);
+    BOOST_CHECK_EQUAL(profile.nMaxOpenFiles, 100);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 0);
+    BOOST_CHECK_EQUAL(profile.nWriteBufferSize, 2 << 20);
+    BOOST_CHECK_EQUAL(profile.nBlockSize, DEFAULT_DB_BLOCK_SIZE);
+    BOOST_CHECK_EQUAL(profile.nBlockCacheSize, (1 << 20) / 2);
+    BOOST_CHECK_EQUAL(profile.nSubcompactions, 2);
+    BOOST_CHECK_EQUAL(profile.nL0Stop, DEFAULT_DB_L0_STOP);
+
+    // Explicit settings win over the bulk write preset
+    CDBProfile bulk("sporks", 1 << 20);
+    bulk.SetBulkWrites();
+    ApplyDBProfileArgs(bulk);
+    BOOST_CHECK_EQUAL(bulk.nSubcompactions, 2);
+    BOOST_CHECK(bulk.nL0Stop > DEFAULT_DB_L0_STOP);
+
+    // A named database opens with the adjusted profile and reports its counters
+    {
+        path ph = temp_directory_path() / unique_path();
+        CDBWrapper dbw(ph, CDBProfile("sporks", 1 << 20), true, false);
+        char key = 'k';
+        uint256 in = GetRandHash();
+        uint256 res;
+        BOOST_CHECK(dbw.Write(key, in));
+        BOOST_CHECK(dbw.Read(key, res));
+        BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+
+        std::vector<CDBStats> vStats = GetDBStats();
+        BOOST_CHECK_EQUAL(vStats.size(), 1);
+        BOOST_CHECK_EQUAL(vStats[0].strName, "sporks");
+        BOOST_CHECK(!vStats[0].vFilesPerLevel.empty());
+    }
+    BOOST_CHECK(GetDBStats().empty());
+
+    mapMultiArgs["-dbprofile"].push_back("sporks:maxopenfiles");
+    BOOST_CHECK(!CheckDBProfileArgs(strError));
+    mapMultiArgs["-dbprofile"].back() = "wallet:maxopenfiles=100";
+    BOOST_CHECK(!CheckDBProfileArgs(strError));
+    mapMultiArgs["-dbprofile"].back() = "sporks:l0stop=0";
+    BOOST_CHECK(!CheckDBProfileArgs(strError));
+    mapMultiArgs["-dbprofile"].back() = "sporks:filesize=100";
+    BOOST_CHECK(!CheckDBProfileArgs(strError));
+    // l0slowdown above the l0stop in effect, given or default
+    mapMultiArgs["-dbprofile"].back() = "sporks:l0slowdown=20";
+    BOOST_CHECK(!CheckDBProfileArgs(strError));
+    mapMultiArgs["-dbprofile"].push_back("sporks:l0stop=20");
+    BOOST_CHECK(CheckDBProfileArgs(strError));
+    // chainstate is held to the bulk write triggers as well
+    mapMultiArgs["-dbprofile"].push_back("chainstate:l0stop=16");
+    BOOST_CHECK(!CheckDBProfileArgs(strError));
+    mapMultiArgs.erase("-dbprofile");
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_bulk_load)
+{
+    path ph = temp_directory_path() / unique_path();
+    path phRuns = temp_directory_path() / unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false);
+    BOOST_CHECK(dbw.Write(make_pair('b', 1), 1));
+
+    // A small memory limit spreads the entries over several runs
+    CDBBulkLoader::Position pos;
+    {
+        CDBBulkLoader loader(phRuns, 4096);
+        BOOST_CHECK(loader.Start());
+        for (int i = 0; i < 1000; i++)
+            BOOST_CHECK(loader.Write(make_pair('d', i), i));
+        for (int i = 0; i < 1000; i += 2)
+            BOOST_CHECK(loader.Erase(make_pair('d', i)));
+        BOOST_CHECK(loader.Write(make_pair('d', 10), 20));
+        BOOST_CHECK(loader.Sync(pos));
+        loader.Committed();
+        // Lost when the loader is resumed from pos
+        BOOST_CHECK(loader.Write(make_pair('d', 11), 0));
+        BOOST_CHECK(loader.Write(make_pair('u', 1), 1));
+    }
+
+    CDBBulkLoader loader(phRuns, 4096);
+    BOOST_CHECK(loader.Resume(pos));
+    BOOST_CHECK(loader.Write(make_pair('p', 5), 5));
+    BOOST_CHECK(loader.Write(make_pair('d', 13), 26));
+    BOOST_CHECK(loader.Finish(dbw));
+    BOOST_CHECK(!exists(phRuns));
+
+    int res;
+    BOOST_CHECK(dbw.Read(make_pair('b', 1), res) && res == 1);
+    BOOST_CHECK(dbw.Read(make_pair('d', 10), res) && res == 20);
+    BOOST_CHECK(dbw.Read(make_pair('d', 11), res) && res == 11);
+    BOOST_CHECK(dbw.Read(make_pair('d', 13), res) && res == 26);
+    BOOST_CHECK(!dbw.Exists(make_pair('d', 12)));
+    BOOST_CHECK(!dbw.Exists(make_pair('u', 1)));
+    BOOST_CHECK(dbw.Read(make_pair('p', 5), res) && res == 5);
+
+    // Later writes override the loaded entries
+    BOOST_CHECK(dbw.Write(make_pair('d', 11), 22));
+    BOOST_CHECK(dbw.Erase(make_pair('d', 13)));
+    BOOST_CHECK(dbw.Read(make_pair('d', 11), res) && res == 22);
+    BOOST_CHECK(!dbw.Exists(make_pair('d', 13)));
+
+    // A range that is already loaded falls back to ordinary writes
+    BOOST_CHECK(loader.Start());
+    BOOST_CHECK(loader.Write(make_pair('d', 12), 24));
+    BOOST_CHECK(loader.Erase(make_pair('d', 15)));
+    BOOST_CHECK(loader.Finish(dbw));
+    BOOST_CHECK(dbw.Read(make_pair('d', 12), res) && res == 24);
+    BOOST_CHECK(!dbw.Exists(make_pair('d', 15)));
+    BOOST_CHECK(dbw.Read(make_pair('d', 11), res) && res == 22);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
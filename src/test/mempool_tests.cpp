@@ -158,6 +158,129 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK(it == pool.mapTx.get<1>().end());
 }
 
+BOOST_AUTO_TEST_CASE(MempoolHashedIndexTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction txParent;
+    txParent.vout.resize(3);
+    for (int i = 0; i < 3; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 1);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+    txChild.vjoinsplit.push_back(JSDescription());
+    txChild.vjoinsplit[0].nullifiers[0] = uint256S("0x01");
+    txChild.vjoinsplit[0].nullifiers[1] = uint256S("0x02");
+
+    size_t nEmptyUsage = pool.DynamicMemoryUsage();
+    pool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+    pool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild));
+    size_t nUsage = pool.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > nEmptyUsage);
+
+    BOOST_CHECK(pool.exists(txChild.GetHash()));
+    BOOST_CHECK(pool.mapNextTx.count(txChild.vin[0].prevout));
+    BOOST_CHECK(pool.nullifierExists(uint256S("0x02"), SPROUT));
+    BOOST_CHECK(!pool.nullifierExists(uint256S("0x02"), SAPLING));
+
+    // Only the output the child spends is pruned
+    CCoins coins(txParent, MEMPOOL_HEIGHT);
+    pool.pruneSpent(txParent.GetHash(), coins);
+    BOOST_CHECK(coins.IsAvailable(0));
+    BOOST_CHECK(!coins.IsAvailable(1));
+    BOOST_CHECK(coins.IsAvailable(2));
+
+    std::list<CTransaction> removed;
+    pool.remove(txParent, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK(pool.mapNextTx.empty());
+    BOOST_CHECK(!pool.nullifierExists(uint256S("0x01"), SPROUT));
+    BOOST_CHECK(pool.DynamicMemoryUsage() < nUsage);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    SetMockTime(42);
+    CTxMemPool pool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).FromTx(tx1));
+
+    // tx2 has the lowest fee rate, but with its child tx3 it pays more than tx1
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(5000LL).FromTx(tx2));
+
+    CMutableTransaction tx3;
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(20000LL).FromTx(tx3));
+
+    size_t nUsage = pool.DynamicMemoryUsage();
+    pool.TrimToSize(nUsage);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    // tx1 is the package with the lowest fee rate, tx2 stays for its child
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    BOOST_CHECK(!pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+    BOOST_CHECK(pool.exists(tx3.GetHash()));
+    CAmount nFirstMinFeePerK = CFeeRate(10000LL, ::GetSerializeSize(tx1, SER_NETWORK, PROTOCOL_VERSION)).GetFeePerK() + 1000;
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nFirstMinFeePerK);
+
+    // Evicting tx2 takes tx3 with it, and the package sets the minimum fee
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+
+    size_t nPackageSize = ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION) + ::GetSerializeSize(tx3, SER_NETWORK, PROTOCOL_VERSION);
+    CAmount nMinFeePerK = CFeeRate(25000LL, nPackageSize).GetFeePerK() + 1000;
+    BOOST_CHECK(nMinFeePerK > nFirstMinFeePerK);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFeePerK);
+
+    // The minimum fee only decays once a block has been connected
+    SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFeePerK);
+
+    std::vector<CTransactionRef> vtx;
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts);
+    SetMockTime(42 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), nMinFeePerK / 2);
+
+    // It halves four times as fast while the pool is nearly empty, and
+    // drops to zero once under half the relay fee
+    SetMockTime(42 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE + CTxMemPool::ROLLING_FEE_HALFLIFE / 4);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nUsage * 5).GetFeePerK(), nMinFeePerK / 4);
+
+    SetMockTime(42 + 10 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     CTxMemPool pool(CFeeRate(0));
     TestMemPoolEntryHelper entry;
@@ -286,6 +286,32 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state, verifier) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(shared_transaction_deserialization)
+{
+    // Blocks deserialize their transactions through CTransaction(deserialize, s),
+    // which moves a CMutableTransaction; every field has to survive the move.
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nExpiryHeight = 100;
+    mtx.valueBalance = -1;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.hash = GetRandHash();
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1;
+    mtx.vShieldedOutput.resize(1);
+    mtx.bindingSig.fill(0x42);
+    CTransaction tx(mtx);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    CTransactionRef ptx;
+    ss >> ptx;
+    BOOST_CHECK(ptx->bindingSig == tx.bindingSig);
+    BOOST_CHECK_EQUAL(ptx->GetHash().ToString(), tx.GetHash().ToString());
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
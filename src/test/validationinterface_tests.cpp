@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "validationinterface.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+class TipRecorder : public CValidationInterface
+{
+public:
+    bool fSynchronous;
+    std::vector<const CBlockIndex*> vTips;
+    boost::thread::id threadId;
+
+    TipRecorder(bool fSynchronousIn) : fSynchronous(fSynchronousIn) {}
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) {
+        vTips.push_back(pindex);
+        threadId = boost::this_thread::get_id();
+    }
+    bool IsSynchronous() const { return fSynchronous; }
+};
+
+BOOST_AUTO_TEST_CASE(async_delivery_in_order)
+{
+    CBlockIndex index[10];
+    TipRecorder recorder(false);
+    RegisterValidationInterface(&recorder);
+    for (int i = 0; i < 10; i++)
+        GetMainSignals().UpdatedBlockTip(&index[i]);
+    SyncWithValidationInterfaceQueues();
+
+    BOOST_CHECK_EQUAL(recorder.vTips.size(), 10);
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK(recorder.vTips[i] == &index[i]);
+    BOOST_CHECK(recorder.threadId != boost::this_thread::get_id());
+
+    UnregisterValidationInterface(&recorder);
+    GetMainSignals().UpdatedBlockTip(&index[0]);
+    BOOST_CHECK_EQUAL(recorder.vTips.size(), 10);
+}
+
+BOOST_AUTO_TEST_CASE(sync_delivery)
+{
+    CBlockIndex index;
+    TipRecorder recorder(true);
+    RegisterValidationInterface(&recorder);
+    GetMainSignals().UpdatedBlockTip(&index);
+
+    BOOST_CHECK_EQUAL(recorder.vTips.size(), 1);
+    BOOST_CHECK(recorder.threadId == boost::this_thread::get_id());
+    UnregisterValidationInterface(&recorder);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -41,12 +41,23 @@ static const char DB_BEST_SAPLING_ANCHOR = 'z';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BULK_LOAD = 'k';
+static const char DB_INDEX_BUILD = 'I';
 
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) 
+static CDBProfile GetCoinsDBProfile(size_t nCacheSize, bool fWipe)
+{
+    CDBProfile profile("chainstate", nCacheSize);
+    // A wiped database is about to be rebuilt by a reindex
+    if (fWipe)
+        profile.SetBulkWrites();
+    return profile;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", GetCoinsDBProfile(nCacheSize, fWipe), fMemory, fWipe)
 {
 }
 
@@ -200,7 +211,24 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+static CDBProfile GetBlockTreeDBProfile(size_t nCacheSize, bool fWipe)
+{
+    CDBProfile profile("blockindex", nCacheSize);
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ||
+        GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+        // The address, spent and timestamp indexes make this database large
+        // and mostly read by prefix scans, which want fewer, larger blocks.
+        profile.nBlockSize = 16 * 1024;
+        // ConnectBlock writes several index entries per transaction, which
+        // would otherwise keep level-0 at the stop trigger.
+        profile.SetBulkWrites();
+    } else if (fWipe) {
+        profile.SetBulkWrites();
+    }
+    return profile;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", GetBlockTreeDBProfile(nCacheSize, fWipe), fMemory, fWipe), fBulkLoading(false) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -278,6 +306,17 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    if (pbulkload) {
+        // The loader's position is stored with the blocks whose index entries it holds
+        CDBBulkLoader::Position pos;
+        if (!pbulkload->Sync(pos))
+            return false;
+        batch.Write(DB_BULK_LOAD, pos);
+        if (!WriteBatch(batch, true))
+            return false;
+        pbulkload->Committed();
+        return true;
+    }
     return WriteBatch(batch, true);
 }
 
@@ -305,6 +344,14 @@ bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 }
 
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    if (pbulkload) {
+        for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+            if (!(it->second.IsNull() ? pbulkload->Erase(make_pair(DB_SPENTINDEX, it->first)) :
+                                        pbulkload->Write(make_pair(DB_SPENTINDEX, it->first), it->second)))
+                return false;
+        }
+        return true;
+    }
     CDBBatch batch(*this);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -317,6 +364,14 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
 }
 
 bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    if (pbulkload) {
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+            if (!(it->second.IsNull() ? pbulkload->Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first)) :
+                                        pbulkload->Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second)))
+                return false;
+        }
+        return true;
+    }
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -355,6 +410,12 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
 }
 
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    if (pbulkload) {
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+            if (!pbulkload->Write(make_pair(DB_ADDRESSINDEX, it->first), it->second))
+                return false;
+        return true;
+    }
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
@@ -362,6 +423,12 @@ bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKe
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    if (pbulkload) {
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+            if (!pbulkload->Erase(make_pair(DB_ADDRESSINDEX, it->first)))
+                return false;
+        return true;
+    }
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
@@ -403,6 +470,8 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
 }
 
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+    if (pbulkload)
+        return pbulkload->Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
     return WriteBatch(batch);
@@ -464,6 +533,68 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteIndexBuild(int nIndexes, const uint256 &hashBlock) {
+    return Write(DB_INDEX_BUILD, make_pair(nIndexes, hashBlock));
+}
+
+bool CBlockTreeDB::ReadIndexBuild(int &nIndexes, uint256 &hashBlock) {
+    std::pair<int, uint256> build;
+    if (!Read(DB_INDEX_BUILD, build))
+        return false;
+    nIndexes = build.first;
+    hashBlock = build.second;
+    return true;
+}
+
+bool CBlockTreeDB::EraseIndexBuild() {
+    return Erase(DB_INDEX_BUILD);
+}
+
+static boost::filesystem::path GetBulkLoadDir()
+{
+    return GetDataDir() / "blocks" / "indexbulk";
+}
+
+bool CBlockTreeDB::StartBulkLoad(size_t nMaxMemory) {
+    pbulkload.reset(new CDBBulkLoader(GetBulkLoadDir(), nMaxMemory));
+    CDBBulkLoader::Position pos;
+    if (!pbulkload->Start() || !pbulkload->Sync(pos) || !Write(DB_BULK_LOAD, pos, true)) {
+        pbulkload.reset();
+        return error("%s: cannot start bulk loading the indexes", __func__);
+    }
+    fBulkLoading = true;
+    LogPrintf("Bulk loading the address, spent and timestamp indexes in %s\n", GetBulkLoadDir().string());
+    return true;
+}
+
+bool CBlockTreeDB::ResumeBulkLoad(size_t nMaxMemory) {
+    CDBBulkLoader::Position pos;
+    if (!Read(DB_BULK_LOAD, pos))
+        return true;
+    pbulkload.reset(new CDBBulkLoader(GetBulkLoadDir(), nMaxMemory));
+    if (!pbulkload->Resume(pos)) {
+        pbulkload.reset();
+        return error("%s: cannot resume bulk loading the indexes, -reindex is required", __func__);
+    }
+    fBulkLoading = true;
+    LogPrintf("Resuming the bulk load of the indexes at run %d\n", pos.first);
+    return true;
+}
+
+bool CBlockTreeDB::FinishBulkLoad() {
+    if (!pbulkload)
+        return true;
+    int64_t nStart = GetTimeMillis();
+    if (!pbulkload->Finish(*this))
+        return error("%s: bulk loading the indexes failed", __func__);
+    pbulkload.reset();
+    fBulkLoading = false;
+    if (!Erase(DB_BULK_LOAD, true))
+        return false;
+    LogPrintf("Bulk loaded the indexes in %dms\n", GetTimeMillis() - nStart);
+    return true;
+}
+
 bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
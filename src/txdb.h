@@ -10,7 +10,9 @@
 #include "coins.h"
 #include "dbwrapper.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -37,6 +39,8 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -bulkindex default (MiB)
+static const int64_t nDefaultBulkIndexMemory = 256;
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -73,6 +77,11 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    //! Collects the address, spent and timestamp index entries while reindexing
+    std::unique_ptr<CDBBulkLoader> pbulkload;
+    //! Set while pbulkload is in use, for readers that do not hold cs_main
+    std::atomic<bool> fBulkLoading;
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo);
@@ -100,6 +109,22 @@ public:
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
     bool blockOnchainActive(const uint256 &hash);
+    //! Progress of the background index builder: the indexes it builds and the last block done
+    bool WriteIndexBuild(int nIndexes, const uint256 &hashBlock);
+    bool ReadIndexBuild(int &nIndexes, uint256 &hashBlock);
+    bool EraseIndexBuild();
+
+    /**
+     * Route the address, spent and timestamp index writes to a bulk loader
+     * using up to nMaxMemory bytes, until FinishBulkLoad(). The indexes
+     * cannot be read in the meantime.
+     */
+    bool StartBulkLoad(size_t nMaxMemory);
+    //! Continue a bulk load interrupted by a shutdown, if there is one
+    bool ResumeBulkLoad(size_t nMaxMemory);
+    bool IsBulkLoading() const { return fBulkLoading; }
+    //! Write the collected index entries to the database as sorted tables
+    bool FinishBulkLoad();
 };
 
 #endif // BITCOIN_TXDB_H
\ No newline at end of file
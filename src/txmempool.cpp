@@ -10,12 +10,15 @@
 #include "consensus/validation.h"
 #include "main.h"
 #include "policy/fees.h"
+#include "random.h"
 #include "streams.h"
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "version.h"
 
+#include <boost/unordered_set.hpp>
+
 using namespace std;
 
 CTxMemPoolEntry::CTxMemPoolEntry():
@@ -25,7 +28,7 @@ CTxMemPoolEntry::CTxMemPoolEntry():
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, double _dPriority,
                                  unsigned int _nHeight, bool poolHasNoInputsOf,
                                  bool _spendsCoinbase, uint32_t _nBranchId):
@@ -33,12 +36,21 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
     hadNoDependencies(poolHasNoInputsOf),
     spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId)
 {
-    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-    nModSize = tx.CalculateModifiedSize(nTxSize);
+    nTxSize = ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = tx->CalculateModifiedSize(nTxSize);
     nUsageSize = RecursiveDynamicUsage(tx);
     feeRate = CFeeRate(nFee, nTxSize);
 }
 
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+                                 int64_t _nTime, double _dPriority,
+                                 unsigned int _nHeight, bool poolHasNoInputsOf,
+                                 bool _spendsCoinbase, uint32_t _nBranchId):
+    CTxMemPoolEntry(MakeTransactionRef(_tx), _nFee, _nTime, _dPriority, _nHeight,
+                    poolHasNoInputsOf, _spendsCoinbase, _nBranchId)
+{
+}
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
 {
     *this = other;
@@ -47,14 +59,21 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
 double
 CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    CAmount nValueIn = tx.GetValueOut()+nFee;
+    CAmount nValueIn = tx->GetValueOut()+nFee;
     double deltaPriority = ((double)(currentHeight-nHeight)*nValueIn)/nModSize;
     double dResult = dPriority + deltaPriority;
     return dResult;
 }
 
+SaltedTxidHasher::SaltedTxidHasher() :
+    k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+SaltedOutpointHasher::SaltedOutpointHasher() :
+    k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), cachedInnerUsage(0), cachedIndexUsage(0), minReasonableRelayFee(_minRelayFee),
+    lastRollingFeeUpdate(GetTime()), blockSinceLastRollingFeeBump(false), rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -73,12 +92,10 @@ void CTxMemPool::pruneSpent(const uint256 &hashTx, CCoins &coins)
 {
     LOCK(cs);
 
-    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
-
-    // iterate over all COutPoints in mapNextTx whose hash equals the provided hashTx
-    while (it != mapNextTx.end() && it->first.hash == hashTx) {
-        coins.Spend(it->first.n); // and remove those outputs from coins
-        it++;
+    // remove the outputs of hashTx that a pooled transaction spends from coins
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (mapNextTx.count(COutPoint(hashTx, i)))
+            coins.Spend(i);
     }
 }
 
@@ -162,6 +179,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
         }
     }
 
+    cachedIndexUsage += memusage::DynamicUsage(inserted);
     mapAddressInserted.insert(make_pair(txhash, inserted));
 }
 
@@ -185,10 +203,11 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
 
     if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+        const std::vector<CMempoolAddressDeltaKey>& keys = (*it).second;
+        for (std::vector<CMempoolAddressDeltaKey>::const_iterator mit = keys.begin(); mit != keys.end(); mit++) {
             mapAddress.erase(*mit);
         }
+        cachedIndexUsage -= memusage::DynamicUsage(keys);
         mapAddressInserted.erase(it);
     }
 
@@ -228,6 +247,7 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCac
 
     }
 
+    cachedIndexUsage += memusage::DynamicUsage(inserted);
     mapSpentInserted.insert(make_pair(txhash, inserted));
 }
 
@@ -250,10 +270,11 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     mapSpentIndexInserted::iterator it = mapSpentInserted.find(txhash);
 
     if (it != mapSpentInserted.end()) {
-        std::vector<CSpentIndexKey> keys = (*it).second;
-        for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+        const std::vector<CSpentIndexKey>& keys = (*it).second;
+        for (std::vector<CSpentIndexKey>::const_iterator mit = keys.begin(); mit != keys.end(); mit++) {
             mapSpent.erase(*mit);
         }
+        cachedIndexUsage -= memusage::DynamicUsage(keys);
         mapSpentInserted.erase(it);
     }
 
@@ -273,7 +294,7 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             // happen during chain re-orgs if origTx isn't re-accepted into
             // the mempool for any reason.
             for (unsigned int i = 0; i < origTx.vout.size(); i++) {
-                std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
+                nextTxMap::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
                 txToRemove.push_back(it->second.ptx->GetHash());
@@ -288,7 +309,7 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             const CTransaction& tx = mapTx.find(hash)->GetTx();
             if (fRecursive) {
                 for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
+                    nextTxMap::iterator it = mapNextTx.find(COutPoint(hash, i));
                     if (it == mapNextTx.end())
                         continue;
                     txToRemove.push_back(it->second.ptx->GetHash());
@@ -392,7 +413,7 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
     list<CTransaction> result;
     LOCK(cs);
     BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
+        nextTxMap::iterator it = mapNextTx.find(txin.prevout);
         if (it != mapNextTx.end()) {
             const CTransaction &txConflict = *it->second.ptx;
             if (txConflict != tx)
@@ -404,7 +425,7 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
     BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
         BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
-            std::map<uint256, const CTransaction*>::iterator it = mapSproutNullifiers.find(nf);
+            nullifierMap::iterator it = mapSproutNullifiers.find(nf);
             if (it != mapSproutNullifiers.end()) {
                 const CTransaction &txConflict = *it->second;
                 if (txConflict != tx) {
@@ -414,7 +435,7 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
         }
     }
     for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
-        std::map<uint256, const CTransaction*>::iterator it = mapSaplingNullifiers.find(spendDescription.nullifier);
+        nullifierMap::iterator it = mapSaplingNullifiers.find(spendDescription.nullifier);
         if (it != mapSaplingNullifiers.end()) {
             const CTransaction &txConflict = *it->second;
             if (txConflict != tx) {
@@ -446,21 +467,22 @@ void CTxMemPool::removeExpired(unsigned int nBlockHeight)
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
  */
-void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                                 std::list<CTransaction>& conflicts, bool fCurrentEstimate)
 {
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    BOOST_FOREACH(const CTransactionRef& ptx, vtx)
     {
-        uint256 hash = tx.GetHash();
+        uint256 hash = ptx->GetHash();
 
         indexed_transaction_set::iterator i = mapTx.find(hash);
         if (i != mapTx.end())
             entries.push_back(*i);
     }
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    BOOST_FOREACH(const CTransactionRef& ptx, vtx)
     {
+        const CTransaction& tx = *ptx;
         std::list<CTransaction> dummy;
         remove(tx, dummy, false);
         removeConflicts(tx, conflicts);
@@ -468,6 +490,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     }
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 /**
@@ -497,8 +521,18 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapSproutNullifiers.clear();
+    mapSaplingNullifiers.clear();
+    mapAddress.clear();
+    mapAddressInserted.clear();
+    mapSpent.clear();
+    mapSpentInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    cachedIndexUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
 }
 
@@ -538,7 +572,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 assert(coins && coins->IsAvailable(txin.prevout.n));
             }
             // Check whether its inputs are marked in mapNextTx.
-            std::map<COutPoint, CInPoint>::const_iterator it3 = mapNextTx.find(txin.prevout);
+            nextTxMap::const_iterator it3 = mapNextTx.find(txin.prevout);
             assert(it3 != mapNextTx.end());
             assert(it3->second.ptx == &tx);
             assert(it3->second.n == i);
@@ -600,7 +634,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             stepsSinceLastRemove = 0;
         }
     }
-    for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
+    for (nextTxMap::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
         uint256 hash = it->second.ptx->GetHash();
         indexed_transaction_set::const_iterator it2 = mapTx.find(hash);
         const CTransaction& tx = it2->GetTx();
@@ -619,7 +653,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
 void CTxMemPool::checkNullifiers(ShieldedType type) const
 {
-    const std::map<uint256, const CTransaction*>* mapToUse;
+    const nullifierMap* mapToUse;
     switch (type) {
         case SPROUT:
             mapToUse = &mapSproutNullifiers;
@@ -649,6 +683,36 @@ void CTxMemPool::queryHashes(vector<uint256>& vtxid)
         vtxid.push_back(mi->GetTx().GetHash());
 }
 
+void CTxMemPool::queryEntries(vector<CTxMemPoolEntry>& vEntries) const
+{
+    vEntries.clear();
+
+    LOCK(cs);
+    vEntries.reserve(mapTx.size());
+    boost::unordered_set<uint256, SaltedTxidHasher> setAdded;
+    std::vector<indexed_transaction_set::const_iterator> vStack;
+    for (indexed_transaction_set::const_iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi) {
+        vStack.push_back(mi);
+        while (!vStack.empty()) {
+            indexed_transaction_set::const_iterator it = vStack.back();
+            bool fParentsAdded = true;
+            BOOST_FOREACH(const CTxIn& txin, it->GetTx().vin) {
+                indexed_transaction_set::const_iterator itParent = mapTx.find(txin.prevout.hash);
+                if (itParent != mapTx.end() && !setAdded.count(txin.prevout.hash)) {
+                    vStack.push_back(itParent);
+                    fParentsAdded = false;
+                    break;
+                }
+            }
+            if (fParentsAdded) {
+                vStack.pop_back();
+                if (setAdded.insert(it->GetTx().GetHash()).second)
+                    vEntries.push_back(*it);
+            }
+        }
+    }
+}
+
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
@@ -658,6 +722,15 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
+CTransactionRef CTxMemPool::get(const uint256& hash) const
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end())
+        return nullptr;
+    return i->GetSharedTx();
+}
+
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
     LOCK(cs);
@@ -718,7 +791,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
 void CTxMemPool::ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount &nFeeDelta)
 {
     LOCK(cs);
-    std::map<uint256, std::pair<double, CAmount> >::iterator pos = mapDeltas.find(hash);
+    boost::unordered_map<uint256, std::pair<double, CAmount>, SaltedTxidHasher>::iterator pos = mapDeltas.find(hash);
     if (pos == mapDeltas.end())
         return;
     const std::pair<double, CAmount> &deltas = pos->second;
@@ -763,9 +836,9 @@ bool CCoinsViewMemPool::GetCoins(const uint256 &txid, CCoins &coins) const {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
-    CTransaction tx;
-    if (mempool.lookup(txid, tx)) {
-        coins = CCoins(tx, MEMPOOL_HEIGHT);
+    CTransactionRef ptx = mempool.get(txid);
+    if (ptx) {
+        coins = CCoins(*ptx, MEMPOOL_HEIGHT);
         return true;
     }
     return (base->GetCoins(txid, coins) && !coins.IsPruned());
@@ -777,6 +850,114 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+    // Each mapTx node holds the entry, the two links of the hashed txid index
+    // and the three of the ordered fee rate index; the hashed index adds a
+    // bucket array, as no exact formula for boost::multi_index_contained is implemented.
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 5 * sizeof(void*)) * mapTx.size() +
+        memusage::MallocUsage(sizeof(void*) * mapTx.bucket_count()) +
+        memusage::DynamicUsage(mapNextTx) +
+        memusage::DynamicUsage(mapSproutNullifiers) +
+        memusage::DynamicUsage(mapSaplingNullifiers) +
+        memusage::DynamicUsage(mapDeltas) +
+        memusage::DynamicUsage(mapAddress) +
+        memusage::DynamicUsage(mapAddressInserted) +
+        memusage::DynamicUsage(mapSpent) +
+        memusage::DynamicUsage(mapSpentInserted) +
+        cachedInnerUsage + cachedIndexUsage;
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 hashCur = queue.front();
+        queue.pop_front();
+        if (!setDescendants.insert(hashCur).second)
+            continue;
+        indexed_transaction_set::const_iterator it = mapTx.find(hashCur);
+        if (it == mapTx.end())
+            continue;
+        for (unsigned int i = 0; i < it->GetTx().vout.size(); i++) {
+            nextTxMap::const_iterator itNext = mapNextTx.find(COutPoint(hashCur, i));
+            if (itNext != mapNextTx.end())
+                queue.push_back(itNext->second.ptx->GetHash());
+        }
+    }
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(rollingMinimumFeeRate);
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < minReasonableRelayFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(rollingMinimumFeeRate), minReasonableRelayFee);
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit)
+{
+    LOCK(cs);
+
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        // Evict the package with the lowest fee rate, a transaction together
+        // with everything spending it. Candidates are visited worst own fee
+        // rate first, so among equal packages the newest goes first.
+        CTransactionRef ptx;
+        CFeeRate removed;
+        for (indexed_transaction_set::nth_index<1>::type::reverse_iterator it = mapTx.get<1>().rbegin(); it != mapTx.get<1>().rend(); ++it) {
+            std::set<uint256> setDescendants;
+            CalculateDescendants(it->GetTx().GetHash(), setDescendants);
+            CAmount nPackageFees = 0;
+            size_t nPackageSize = 0;
+            BOOST_FOREACH(const uint256& hash, setDescendants) {
+                indexed_transaction_set::const_iterator itDesc = mapTx.find(hash);
+                nPackageFees += itDesc->GetFee();
+                nPackageSize += itDesc->GetTxSize();
+            }
+            CFeeRate rate(nPackageFees, nPackageSize);
+            if (!ptx || rate < removed) {
+                ptx = it->GetSharedTx();
+                removed = rate;
+            }
+        }
+
+        removed += minReasonableRelayFee;
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        std::list<CTransaction> txRemoved;
+        remove(*ptx, txRemoved, true);
+        nTxnRemoved += txRemoved.size();
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
 }
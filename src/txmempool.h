@@ -7,18 +7,23 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "addressindex.h"
 #include "spentindex.h"
 #include "amount.h"
 #include "coins.h"
+#include "hash.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
 #undef foreach
 #include "boost/multi_index_container.hpp"
+#include "boost/multi_index/hashed_index.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
+#include <boost/unordered_map.hpp>
+
 class CAutoFile;
 
 inline double AllowFreeThreshold()
@@ -42,7 +47,7 @@ static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 class CTxMemPoolEntry
 {
 private:
-    CTransaction tx;
+    CTransactionRef tx;
     CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize; //! ... and avoid recomputing tx size
     size_t nModSize; //! ... and modified size for priority
@@ -56,13 +61,18 @@ private:
     uint32_t nBranchId; //! Branch ID this transaction is known to commit to, cached for efficiency
 
 public:
+    CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
+                    int64_t _nTime, double _dPriority, unsigned int _nHeight,
+                    bool poolHasNoInputsOf, bool spendsCoinbase, uint32_t nBranchId);
+    //! Makes a new reference holding a copy of _tx
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
                     int64_t _nTime, double _dPriority, unsigned int _nHeight,
                     bool poolHasNoInputsOf, bool spendsCoinbase, uint32_t nBranchId);
     CTxMemPoolEntry();
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
-    const CTransaction& GetTx() const { return this->tx; }
+    const CTransaction& GetTx() const { return *this->tx; }
+    CTransactionRef GetSharedTx() const { return this->tx; }
     double GetPriority(unsigned int currentHeight) const;
     CAmount GetFee() const { return nFee; }
     CFeeRate GetFeeRate() const { return feeRate; }
@@ -99,6 +109,42 @@ public:
 
 class CBlockPolicyEstimator;
 
+/**
+ * Hash of a txid or nullifier under a salt chosen per process, so that
+ * peers cannot pick keys that all land in the same bucket of the
+ * hashed mempool indexes.
+ */
+class SaltedTxidHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    SaltedTxidHasher();
+
+    size_t operator()(const uint256& txid) const {
+        return SipHashUint256(k0, k1, txid);
+    }
+};
+
+/** Salted hash of an outpoint, or of the spent index key naming one */
+class SaltedOutpointHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    SaltedOutpointHasher();
+
+    size_t operator()(const COutPoint& outpoint) const {
+        return SipHashUint256Extra(k0, k1, outpoint.hash, outpoint.n);
+    }
+
+    size_t operator()(const CSpentIndexKey& key) const {
+        return SipHashUint256Extra(k0, k1, key.txid, key.outputIndex);
+    }
+};
+
 /** An inpoint - a combination of a transaction and an index n into its vin */
 class CInPoint
 {
@@ -132,18 +178,32 @@ private:
 
     uint64_t totalTxSize = 0; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    uint64_t cachedIndexUsage; //! sum of dynamic memory usage of the key lists in mapAddressInserted and mapSpentInserted
 
-    std::map<uint256, const CTransaction*> mapSproutNullifiers;
-    std::map<uint256, const CTransaction*> mapSaplingNullifiers;
+    CFeeRate minReasonableRelayFee; //! what each eviction adds to the fee rate it evicted
+
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
+    typedef boost::unordered_map<uint256, const CTransaction*, SaltedTxidHasher> nullifierMap;
+    nullifierMap mapSproutNullifiers;
+    nullifierMap mapSaplingNullifiers;
 
     void checkNullifiers(ShieldedType type) const;
-    
+
+    //! Add the pooled transactions spending hash, directly or not, to setDescendants
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+    void trackPackageRemoved(const CFeeRate& rate);
+
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
+
     typedef boost::multi_index_container<
         CTxMemPoolEntry,
         boost::multi_index::indexed_by<
-            // sorted by txid
-            boost::multi_index::ordered_unique<mempoolentry_txid>,
+            // hashed by txid
+            boost::multi_index::hashed_unique<mempoolentry_txid, SaltedTxidHasher>,
             // sorted by fee rate
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::identity<CTxMemPoolEntry>,
@@ -159,18 +219,19 @@ private:
     typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
+    typedef boost::unordered_map<uint256, std::vector<CMempoolAddressDeltaKey>, SaltedTxidHasher> addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
+    typedef boost::unordered_map<CSpentIndexKey, CSpentIndexValue, SaltedOutpointHasher> mapSpentIndex;
     mapSpentIndex mapSpent;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
+    typedef boost::unordered_map<uint256, std::vector<CSpentIndexKey>, SaltedTxidHasher> mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
 public:
-    std::map<COutPoint, CInPoint> mapNextTx;
-    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    typedef boost::unordered_map<COutPoint, CInPoint, SaltedOutpointHasher> nextTxMap;
+    nextTxMap mapNextTx;
+    boost::unordered_map<uint256, std::pair<double, CAmount>, SaltedTxidHasher> mapDeltas;
 
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
@@ -200,11 +261,13 @@ public:
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
     void removeExpired(unsigned int nBlockHeight);
-    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+    void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void removeWithoutBranchId(uint32_t nMemPoolBranchId);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
+    //! Copies of all entries, each after the pooled transactions it spends
+    void queryEntries(std::vector<CTxMemPoolEntry>& vEntries) const;
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -221,6 +284,22 @@ public:
 
     bool nullifierExists(const uint256& nullifier, ShieldedType type) const;
 
+    /**
+     * The minimum fee to get into the pool, which may itself not be enough
+     * for larger-sized transactions. Evicting a package raises it to the
+     * package's fee rate plus the relay fee; it then halves every
+     * ROLLING_FEE_HALFLIFE, faster while the pool is well below sizelimit,
+     * once a block has been connected since the last increase.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
+    /**
+     * Remove transactions from the pool until its dynamic size is <=
+     * sizelimit. Each step evicts the package with the lowest fee rate: a
+     * transaction together with everything that spends it.
+     */
+    void TrimToSize(size_t sizelimit);
+
     unsigned long size()
     {
         LOCK(cs);
@@ -240,6 +319,8 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    //! The pooled transaction itself instead of a copy; null if not in the pool
+    CTransactionRef get(const uint256& hash) const;
 
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
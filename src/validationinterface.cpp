@@ -6,6 +6,18 @@
 
 #include "validationinterface.h"
 
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "util.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
 static CMainSignals g_signals;
 
 CMainSignals& GetMainSignals()
@@ -13,7 +25,177 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
+/**
+ * Delivers the notifications of one asynchronous subscriber on a dedicated
+ * thread, in the order in which they were signalled. Block pointers are only
+ * valid for the duration of a signal, so blocks are copied; consecutive
+ * notifications about the same block (one SyncTransaction per transaction it
+ * contains, then ChainTip) share a single copy.
+ */
+class CValidationInterfaceQueue
+{
+private:
+    CValidationInterface* pinterface;
+    std::vector<boost::signals2::connection> vConnections;
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDrained;
+    std::deque<boost::function<void ()> > queue;
+    bool fBusy;
+    bool fStop;
+    const CBlock* pblockLast;
+    std::shared_ptr<const CBlock> blockLast;
+    boost::thread thread;
+
+    void Enqueue(const boost::function<void ()>& func)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            queue.push_back(func);
+        }
+        condWork.notify_one();
+    }
+
+    std::shared_ptr<const CBlock> CopyBlock(const CBlock* pblock)
+    {
+        if (pblock == NULL)
+            return std::shared_ptr<const CBlock>();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (pblock != pblockLast || blockLast->GetHash() != pblock->GetHash()) {
+            blockLast = std::make_shared<const CBlock>(*pblock);
+            pblockLast = pblock;
+        }
+        return blockLast;
+    }
+
+    void ThreadMain()
+    {
+        RenameThread("vidulum-notify");
+        while (true) {
+            boost::function<void ()> func;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty() && !fStop)
+                    condWork.wait(lock);
+                if (queue.empty())
+                    return;
+                func = queue.front();
+                queue.pop_front();
+                fBusy = true;
+            }
+            try {
+                func();
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, "CValidationInterfaceQueue");
+            } catch (...) {
+                PrintExceptionContinue(NULL, "CValidationInterfaceQueue");
+            }
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                fBusy = false;
+                if (queue.empty())
+                    condDrained.notify_all();
+            }
+        }
+    }
+
+    void UpdatedBlockTip(const CBlockIndex *pindex)
+    {
+        Enqueue([=] { pinterface->UpdatedBlockTip(pindex); });
+    }
+
+    void SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+    {
+        std::shared_ptr<const CBlock> block = CopyBlock(pblock);
+        Enqueue([=] { pinterface->SyncTransaction(tx, block.get()); });
+    }
+
+    void EraseFromWallet(const uint256 &hash)
+    {
+        Enqueue([=] { pinterface->EraseFromWallet(hash); });
+    }
+
+    void UpdatedTransaction(const uint256 &hash)
+    {
+        Enqueue([=] { pinterface->UpdatedTransaction(hash); });
+    }
+
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added)
+    {
+        std::shared_ptr<const CBlock> block = CopyBlock(pblock);
+        Enqueue([=] { pinterface->ChainTip(pindex, block.get(), sproutTree, saplingTree, added); });
+    }
+
+    void SetBestChain(const CBlockLocator &locator)
+    {
+        Enqueue([=] { pinterface->SetBestChain(locator); });
+    }
+
+    void Inventory(const uint256 &hash)
+    {
+        Enqueue([=] { pinterface->Inventory(hash); });
+    }
+
+    void ResendWalletTransactions(int64_t nBestBlockTime)
+    {
+        Enqueue([=] { pinterface->ResendWalletTransactions(nBestBlockTime); });
+    }
+
+    void BlockChecked(const CBlock &block, const CValidationState &state)
+    {
+        std::shared_ptr<const CBlock> pblock = CopyBlock(&block);
+        Enqueue([=] { pinterface->BlockChecked(*pblock, state); });
+    }
+
+public:
+    CValidationInterfaceQueue(CValidationInterface* pinterfaceIn) :
+        pinterface(pinterfaceIn), fBusy(false), fStop(false), pblockLast(NULL)
+    {
+        thread = boost::thread(&CValidationInterfaceQueue::ThreadMain, this);
+
+        vConnections.push_back(g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterfaceQueue::UpdatedBlockTip, this, _1)));
+        vConnections.push_back(g_signals.SyncTransaction.connect(boost::bind(&CValidationInterfaceQueue::SyncTransaction, this, _1, _2)));
+        vConnections.push_back(g_signals.EraseTransaction.connect(boost::bind(&CValidationInterfaceQueue::EraseFromWallet, this, _1)));
+        vConnections.push_back(g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterfaceQueue::UpdatedTransaction, this, _1)));
+        vConnections.push_back(g_signals.ChainTip.connect(boost::bind(&CValidationInterfaceQueue::ChainTip, this, _1, _2, _3, _4, _5)));
+        vConnections.push_back(g_signals.SetBestChain.connect(boost::bind(&CValidationInterfaceQueue::SetBestChain, this, _1)));
+        vConnections.push_back(g_signals.Inventory.connect(boost::bind(&CValidationInterfaceQueue::Inventory, this, _1)));
+        vConnections.push_back(g_signals.Broadcast.connect(boost::bind(&CValidationInterfaceQueue::ResendWalletTransactions, this, _1)));
+        vConnections.push_back(g_signals.BlockChecked.connect(boost::bind(&CValidationInterfaceQueue::BlockChecked, this, _1, _2)));
+    }
+
+    /** Stop accepting notifications, deliver the ones already queued and join the thread */
+    ~CValidationInterfaceQueue()
+    {
+        BOOST_FOREACH(boost::signals2::connection& conn, vConnections)
+            conn.disconnect();
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        condWork.notify_one();
+        thread.join();
+    }
+
+    void WaitUntilDrained()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!queue.empty() || fBusy)
+            condDrained.wait(lock);
+    }
+};
+
+/** The queues of the asynchronous subscribers, keyed by subscriber. */
+static boost::mutex csValidationInterfaceQueues;
+static std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue> > mapValidationInterfaceQueues;
+
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
+    if (!pwalletIn->IsSynchronous()) {
+        boost::unique_lock<boost::mutex> lock(csValidationInterfaceQueues);
+        mapValidationInterfaceQueues[pwalletIn] = std::make_shared<CValidationInterfaceQueue>(pwalletIn);
+        return;
+    }
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
     g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
@@ -26,6 +208,20 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    std::shared_ptr<CValidationInterfaceQueue> queue;
+    {
+        boost::unique_lock<boost::mutex> lock(csValidationInterfaceQueues);
+        std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue> >::iterator it = mapValidationInterfaceQueues.find(pwalletIn);
+        if (it != mapValidationInterfaceQueues.end()) {
+            queue = it->second;
+            mapValidationInterfaceQueues.erase(it);
+        }
+    }
+    if (queue) {
+        // Destroying the queue delivers what is left in it
+        queue.reset();
+        return;
+    }
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1));
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -47,6 +243,24 @@ void UnregisterAllValidationInterfaces() {
     g_signals.EraseTransaction.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
+
+    std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue> > mapQueues;
+    {
+        boost::unique_lock<boost::mutex> lock(csValidationInterfaceQueues);
+        mapQueues.swap(mapValidationInterfaceQueues);
+    }
+    mapQueues.clear();
+}
+
+void SyncWithValidationInterfaceQueues() {
+    std::vector<std::shared_ptr<CValidationInterfaceQueue> > vQueues;
+    {
+        boost::unique_lock<boost::mutex> lock(csValidationInterfaceQueues);
+        for (std::map<CValidationInterface*, std::shared_ptr<CValidationInterfaceQueue> >::iterator it = mapValidationInterfaceQueues.begin(); it != mapValidationInterfaceQueues.end(); ++it)
+            vQueues.push_back(it->second);
+    }
+    BOOST_FOREACH(std::shared_ptr<CValidationInterfaceQueue>& queue, vQueues)
+        queue->WaitUntilDrained();
 }
 
 void SyncWithWallets(const CTransaction &tx, const CBlock *pblock) {
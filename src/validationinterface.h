@@ -16,17 +16,25 @@ class CBlockIndex;
 struct CBlockLocator;
 class CTransaction;
 class CValidationInterface;
+class CValidationInterfaceQueue;
 class CValidationState;
 class uint256;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
+/**
+ * Register a wallet to receive updates from core. Unless it asks for
+ * synchronous delivery (see CValidationInterface::IsSynchronous), its
+ * callbacks run in order on a thread of its own, after the signalling
+ * code (which usually holds cs_main) has moved on.
+ */
 void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/** Unregister a wallet from core, after delivering what is queued for it */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+/** Wait until all queued notifications have been delivered. Must not be called with cs_main held. */
+void SyncWithValidationInterfaceQueues();
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
 
@@ -41,6 +49,13 @@ protected:
     virtual void Inventory(const uint256 &hash) {}
     virtual void ResendWalletTransactions(int64_t nBestBlockTime) {}
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
+    /**
+     * Whether to be called directly from the signalling thread. Needed by
+     * subscribers whose state is read back right after the event, such as
+     * the wallet, at the cost of adding to block connection latency.
+     */
+    virtual bool IsSynchronous() const { return false; }
+    friend class ::CValidationInterfaceQueue;
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
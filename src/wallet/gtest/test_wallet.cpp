@@ -116,7 +116,7 @@ std::pair<JSOutPoint, SaplingOutPoint> CreateValidBlock(TestWallet& wallet,
     auto saplingNotes = SetSaplingNoteData(wtx);
     wallet.AddToWallet(wtx, true, NULL);
 
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     wallet.IncrementNoteWitnesses(&index, &block, sproutTree, saplingTree);
 
     return std::make_pair(jsoutpt, saplingNotes[0]);
@@ -201,7 +201,7 @@ TEST(WalletTests, FindUnspentSproutNotes) {
     // Fake-mine the transaction
     EXPECT_EQ(-1, chainActive.Height());
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -238,7 +238,7 @@ TEST(WalletTests, FindUnspentSproutNotes) {
     // Fake-mine a spend transaction
     EXPECT_EQ(0, chainActive.Height());
     CBlock block2;
-    block2.vtx.push_back(wtx2);
+    block2.vtx.push_back(MakeTransactionRef(wtx2));
     block2.hashMerkleRoot = block2.BuildMerkleTree();
     block2.hashPrevBlock = blockHash;
     auto blockHash2 = block2.GetHash();
@@ -297,7 +297,7 @@ TEST(WalletTests, FindUnspentSproutNotes) {
     // Fake-mine the new transaction
     EXPECT_EQ(1, chainActive.Height());
     CBlock block3;
-    block3.vtx.push_back(wtx3);
+    block3.vtx.push_back(MakeTransactionRef(wtx3));
     block3.hashMerkleRoot = block3.BuildMerkleTree();
     block3.hashPrevBlock = blockHash2;
     auto blockHash3 = block3.GetHash();
@@ -655,7 +655,7 @@ TEST(WalletTests, GetConflictedSaplingNotes) {
     EXPECT_EQ(-1, chainActive.Height());
     SproutMerkleTree sproutTree;
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -765,7 +765,7 @@ TEST(WalletTests, SproutNullifierIsSpent) {
     // Fake-mine the transaction
     EXPECT_EQ(-1, chainActive.Height());
     CBlock block;
-    block.vtx.push_back(wtx2);
+    block.vtx.push_back(MakeTransactionRef(wtx2));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -830,7 +830,7 @@ TEST(WalletTests, SaplingNullifierIsSpent) {
     // Fake-mine the transaction
     EXPECT_EQ(-1, chainActive.Height());
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -928,7 +928,7 @@ TEST(WalletTests, NavigateFromSaplingNullifierToNote) {
     EXPECT_EQ(-1, chainActive.Height());
     SproutMerkleTree sproutTree;
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -1056,7 +1056,7 @@ TEST(WalletTests, SpentSaplingNoteIsFromMe) {
     EXPECT_EQ(-1, chainActive.Height());
     SproutMerkleTree sproutTree;
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -1131,7 +1131,7 @@ TEST(WalletTests, SpentSaplingNoteIsFromMe) {
     // Fake-mine this tx into the next block
     EXPECT_EQ(0, chainActive.Height());
     CBlock block2;
-    block2.vtx.push_back(wtx2);
+    block2.vtx.push_back(MakeTransactionRef(wtx2));
     block2.hashMerkleRoot = block2.BuildMerkleTree();
     block2.hashPrevBlock = blockHash;
     auto blockHash2 = block2.GetHash();
@@ -1207,7 +1207,7 @@ TEST(WalletTests, CachedWitnessesEmptyChain) {
     EXPECT_FALSE((bool) saplingWitnesses[0]);
 
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     CBlockIndex index(block);
     SproutMerkleTree sproutTree;
     SaplingMerkleTree saplingTree;
@@ -1276,7 +1276,7 @@ TEST(WalletTests, CachedWitnessesChainTip) {
         // Second block
         CBlock block2;
         block2.hashPrevBlock = block1.GetHash();
-        block2.vtx.push_back(wtx);
+        block2.vtx.push_back(MakeTransactionRef(wtx));
         CBlockIndex index2(block2);
         index2.nHeight = 2;
         SproutMerkleTree sproutTree2 {sproutTree};
@@ -1760,7 +1760,7 @@ TEST(WalletTests, UpdatedSaplingNoteData) {
     EXPECT_EQ(-1, chainActive.Height());
     SproutMerkleTree sproutTree;
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -1914,7 +1914,7 @@ TEST(WalletTests, MarkAffectedSaplingTransactionsDirty) {
     SaplingMerkleTree saplingTree;
     SproutMerkleTree sproutTree;
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = block.BuildMerkleTree();
     auto blockHash = block.GetHash();
     CBlockIndex fakeIndex {block};
@@ -859,6 +859,20 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+/** Whether a transaction in the main chain spends the output */
+bool CWallet::IsSpentInBlock(const uint256& hash, unsigned int n) const
+{
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(COutPoint(hash, n));
+
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0)
+            return true;
+    }
+    return false;
+}
+
 /**
  * Note is spent if any non-conflicted transaction
  * spends it:
@@ -1126,7 +1140,8 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         pblock = &block;
     }
 
-    for (const CTransaction& tx : pblock->vtx) {
+    for (const CTransactionRef& ptx : pblock->vtx) {
+        const CTransaction& tx = *ptx;
         auto hash = tx.GetHash();
         bool txIsOurs = mapWallet.count(hash);
         // Sprout
@@ -1481,8 +1496,8 @@ void CWallet::UpdateSaplingNullifierNoteMapWithTx(CWalletTx& wtx) {
 void CWallet::UpdateSaplingNullifierNoteMapForBlock(const CBlock *pblock) {
     LOCK(cs_wallet);
 
-    for (const CTransaction& tx : pblock->vtx) {
-        auto hash = tx.GetHash();
+    for (const CTransactionRef& ptx : pblock->vtx) {
+        auto hash = ptx->GetHash();
         bool txIsOurs = mapWallet.count(hash);
         if (txIsOurs) {
             UpdateSaplingNullifierNoteMapWithTx(mapWallet[hash]);
@@ -1500,6 +1515,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         mapWallet[hash].BindWallet(this);
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
         AddToSpends(hash);
+        AddToObfuscationIndex(mapWallet[hash]);
     }
     else
     {
@@ -1561,6 +1577,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
                              wtxIn.hashBlock.ToString());
             }
             AddToSpends(hash);
+            AddToObfuscationIndex(wtx);
         }
 
         bool fUpdated = false;
@@ -2111,6 +2128,81 @@ bool CWallet::IsDenominatedAmount(CAmount nInputAmount) const
     return false;
 }
 
+void CWallet::AddToObfuscationIndex(const CWalletTx& wtx) const
+{
+    if (!fObfuscationIndexBuilt) return;
+
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        // Only outputs we can sign for, nothing ever removes the others
+        if ((IsMine(wtx.vout[i]) & ISMINE_SPENDABLE) == ISMINE_NO)
+            continue;
+        CAmount nValue = wtx.vout[i].nValue;
+        if (IsDenominatedAmount(nValue))
+            mapDenominatedCoins[nValue].insert(COutPoint(hash, i));
+        else if (IsCollateralAmount(nValue))
+            setCollateralCoins.insert(COutPoint(hash, i));
+    }
+}
+
+void CWallet::BuildObfuscationIndex() const
+{
+    AssertLockHeld(cs_wallet);
+    if (fObfuscationIndexBuilt) return;
+
+    fObfuscationIndexBuilt = true;
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        AddToObfuscationIndex(it->second);
+}
+
+/** Whether AvailableCoins and AvailableIndexedCoins may take outputs of pcoin */
+static bool IsAvailableCoinTx(const CWalletTx* pcoin, bool fOnlyConfirmed, bool fIncludeCoinBase)
+{
+    if (!CheckFinalTx(*pcoin))
+        return false;
+    if (fOnlyConfirmed && !pcoin->IsTrusted())
+        return false;
+    if (pcoin->IsCoinBase() && (!fIncludeCoinBase || pcoin->GetBlocksToMaturity() > 0))
+        return false;
+    return true;
+}
+
+void CWallet::AvailableIndexedCoins(std::set<COutPoint>& setIndex, vector<COutput>& vCoins, bool fOnlyConfirmed) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::set<COutPoint>::iterator it = setIndex.begin();
+    while (it != setIndex.end()) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(it->hash);
+        if (mi == mapWallet.end() || IsSpentInBlock(it->hash, it->n)) {
+            setIndex.erase(it++);
+            continue;
+        }
+        // An unconfirmed spend may still conflict, keep the output indexed
+        if (IsSpent(it->hash, it->n)) {
+            ++it;
+            continue;
+        }
+
+        const CWalletTx* pcoin = &mi->second;
+        unsigned int i = (it++)->n;
+
+        if (!IsAvailableCoinTx(pcoin, fOnlyConfirmed, true))
+            continue;
+        int nDepth = pcoin->GetDepthInMainChain(false);
+        if (nDepth < 0)
+            continue;
+
+        // Mixing signs its own inputs, so watch-only outputs are of no use
+        isminetype mine = IsMine(pcoin->vout[i]);
+        if ((mine & ISMINE_SPENDABLE) == ISMINE_NO || IsLockedCoin(pcoin->GetHash(), i))
+            continue;
+
+        vCoins.emplace_back(COutput(pcoin, i, nDepth, true));
+    }
+}
+
 bool CWallet::IsChange(const CTxOut& txout) const
 {
     // TODO: fix handling of 'change' outputs. The assumption is that any
@@ -2687,9 +2779,9 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
         CBlock block;
         ReadBlockFromDisk(block, pindex);
 
-        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
         {
-            BOOST_FOREACH(const JSDescription& jsdesc, tx.vjoinsplit)
+            BOOST_FOREACH(const JSDescription& jsdesc, ptx->vjoinsplit)
             {
                 BOOST_FOREACH(const uint256 &note_commitment, jsdesc.commitments)
                 {
@@ -2765,10 +2857,10 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 
             CBlock block;
             ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+            BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
-                    myTxHashes.push_back(tx.GetHash());
+                if (AddToWalletIfInvolvingMe(*ptx, &block, fUpdate)) {
+                    myTxHashes.push_back(ptx->GetHash());
                     ret++;
                 }
             }
@@ -2851,11 +2943,19 @@ bool CWalletTx::RelayWalletTransaction(std::string strCommand)
             uint256 hash = GetHash();
             LogPrintf("Relaying wtx %s\n", hash.ToString());
             if(strCommand == "ix"){
-                mapTxLockReq.insert(make_pair(hash, (CTransaction)*this));
+                {
+                    LOCK(cs_swifttx);
+                    mapTxLockReq.insert(make_pair(hash, (CTransaction)*this));
+                }
                 CreateNewLock(((CTransaction)*this));
                 RelayTransactionLockReq((CTransaction)*this, true);
             } else {
-                RelayTransaction((CTransaction)*this);
+                // Share the mempool's copy rather than relaying another one
+                CTransactionRef ptx = mempool.get(hash);
+                if (ptx)
+                    RelayTransaction(ptx);
+                else
+                    RelayTransaction((CTransaction)*this);
             }
             return true;
         }
@@ -3412,16 +3512,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
 
-            if (!CheckFinalTx(*pcoin))
-                continue;
-
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
-
-            if (pcoin->IsCoinBase() && !fIncludeCoinBase)
-                continue;
-
-            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+            if (!IsAvailableCoinTx(pcoin, fOnlyConfirmed, fIncludeCoinBase))
                 continue;
 
             int nDepth = pcoin->GetDepthInMainChain(false);
@@ -3761,7 +3852,12 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount
     vCoinsRet2.clear();
     vector<COutput> vCoins;
 
-    AvailableCoins(vCoins, true, NULL, ONLY_DENOMINATED);
+    {
+        LOCK2(cs_main, cs_wallet);
+        BuildObfuscationIndex();
+        for (std::map<CAmount, std::set<COutPoint> >::iterator it = mapDenominatedCoins.begin(); it != mapDenominatedCoins.end(); ++it)
+            AvailableIndexedCoins(it->second, vCoins, true);
+    }
 
     std::random_shuffle(vCoins.rbegin(), vCoins.rend());
 
@@ -3869,7 +3965,14 @@ bool CWallet::SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<
 
     vector<COutput> vCoins;
 
-    AvailableCoins(vCoins, true, coinControl, nObfuscationRoundsMin < 0 ? ONLY_NONDENOMINATED_NOT15000IFMN : ONLY_DENOMINATED);
+    if (nObfuscationRoundsMin < 0) {
+        AvailableCoins(vCoins, true, coinControl, false, true, ONLY_NONDENOMINATED_NOT15000IFMN);
+    } else {
+        LOCK2(cs_main, cs_wallet);
+        BuildObfuscationIndex();
+        for (std::map<CAmount, std::set<COutPoint> >::iterator it = mapDenominatedCoins.begin(); it != mapDenominatedCoins.end(); ++it)
+            AvailableIndexedCoins(it->second, vCoins, true);
+    }
 
     set<pair<const CWalletTx*, unsigned int> > setCoinsRet2;
 
@@ -3909,7 +4012,11 @@ bool CWallet::SelectCoinsCollateral(std::vector<CTxIn>& setCoinsRet, CAmount& nV
     vector<COutput> vCoins;
 
     //LogPrintf(" selecting coins for collateral\n");
-    AvailableCoins(vCoins);
+    {
+        LOCK2(cs_main, cs_wallet);
+        BuildObfuscationIndex();
+        AvailableIndexedCoins(setCollateralCoins, vCoins, true);
+    }
 
     //LogPrintf("found coins %d\n", (int)vCoins.size());
 
@@ -3936,22 +4043,22 @@ int CWallet::CountInputsWithAmount(CAmount nInputAmount)
     CAmount nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted()) {
-                int nDepth = pcoin->GetDepthInMainChain(false);
-
-                for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                    COutput out = COutput(pcoin, i, nDepth, true);
-                    CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
-
-                    if (out.tx->vout[out.i].nValue != nInputAmount) continue;
-                    if (!IsDenominatedAmount(pcoin->vout[i].nValue)) continue;
-                    if (IsSpent(out.tx->GetHash(), i) || IsMine(pcoin->vout[i]) != ISMINE_SPENDABLE || !IsDenominated(vin)) continue;
-
-                    nTotal++;
-                }
+        if (!IsDenominatedAmount(nInputAmount)) return 0;
+        BuildObfuscationIndex();
+
+        std::set<COutPoint>& setCoins = mapDenominatedCoins[nInputAmount];
+        std::set<COutPoint>::iterator it = setCoins.begin();
+        while (it != setCoins.end()) {
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(it->hash);
+            if (mi == mapWallet.end() || IsSpent(it->hash, it->n)) {
+                setCoins.erase(it++);
+                continue;
             }
+
+            const CWalletTx* pcoin = &mi->second;
+            unsigned int i = (it++)->n;
+            if (pcoin->IsTrusted() && IsMine(pcoin->vout[i]) == ISMINE_SPENDABLE)
+                nTotal++;
         }
     }
 
@@ -3962,13 +4069,11 @@ bool CWallet::HasCollateralInputs(bool fOnlyConfirmed) const
 {
     vector<COutput> vCoins;
 
-    AvailableCoins(vCoins, fOnlyConfirmed);
-
-    int nFound = 0;
-    BOOST_FOREACH (const COutput& out, vCoins)
-        if (IsCollateralAmount(out.tx->vout[out.i].nValue)) nFound++;
+    LOCK2(cs_main, cs_wallet);
+    BuildObfuscationIndex();
+    AvailableIndexedCoins(setCollateralCoins, vCoins, fOnlyConfirmed);
 
-    return nFound > 0;
+    return !vCoins.empty();
 }
 
 bool CWallet::IsCollateralAmount(CAmount nInputAmount) const
@@ -5408,7 +5513,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock& block)
 
     // Locate the transaction
     for (nIndex = 0; nIndex < (int)block.vtx.size(); nIndex++)
-        if (block.vtx[nIndex] == *(CTransaction*)this)
+        if (*block.vtx[nIndex] == *(CTransaction*)this)
             break;
     if (nIndex == (int)block.vtx.size())
     {
@@ -5499,6 +5604,7 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if (!fEnableSwiftTX) return -1;
 
     //compile consessus vote
+    LOCK(cs_swifttx);
     std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
     if (i != mapTxLocks.end()) {
         return (*i).second.CountSignatures();
@@ -5512,6 +5618,7 @@ bool CMerkleTx::IsTransactionLockTimedOut() const
     if (!fEnableSwiftTX) return 0;
 
     //compile consessus vote
+    LOCK(cs_swifttx);
     std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
     if (i != mapTxLocks.end()) {
         return GetTime() > (*i).second.nTimeout;
@@ -822,6 +822,23 @@ private:
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Obfuscation inputs by value: denominated outputs per denomination and
+     * collateral sized outputs. Built on first use, as the denominations are
+     * only set up after the wallet is loaded, and then kept current by
+     * AddToWallet. Only outputs we can spend are indexed. Outputs spent in a
+     * block, and erased ones, are dropped when selection meets them.
+     */
+    mutable bool fObfuscationIndexBuilt;
+    mutable std::map<CAmount, std::set<COutPoint> > mapDenominatedCoins;
+    mutable std::set<COutPoint> setCollateralCoins;
+
+    void AddToObfuscationIndex(const CWalletTx& wtx) const;
+    void BuildObfuscationIndex() const;
+    /** AvailableCoins over the outputs in setIndex only */
+    void AvailableIndexedCoins(std::set<COutPoint>& setIndex, std::vector<COutput>& vCoins, bool fOnlyConfirmed) const;
+    bool IsSpentInBlock(const uint256& hash, unsigned int n) const;
+
 public:
     bool SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const;
     bool SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax);
@@ -956,6 +973,7 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        fObfuscationIndexBuilt = false;
     }
 
     /**
@@ -1283,6 +1301,8 @@ boost::optional<uint256> GetSproutNoteNullifier(
     CAmount GetAvailableWatchOnlyCredit(const bool& fUseCache = true) const;
     
     void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added);
+    /** Witnesses and balances must be current as soon as a block is connected. */
+    bool IsSynchronous() const { return true; }
     /** Saves witness caches and best block locator to disk. */
     void SetBestChain(const CBlockLocator& loc);
     std::set<std::pair<libzcash::PaymentAddress, uint256>> GetNullifiersForAddresses(const std::set<libzcash::PaymentAddress> & addresses);
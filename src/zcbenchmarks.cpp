@@ -321,7 +321,7 @@ double benchmark_increment_note_witnesses(size_t nTxs)
 
         wtx.SetSproutNoteData(noteData);
         wallet.AddToWallet(wtx, true, NULL);
-        block1.vtx.push_back(wtx);
+        block1.vtx.push_back(MakeTransactionRef(wtx));
     }
     CBlockIndex index1(block1);
     index1.nHeight = 1;
@@ -344,7 +344,7 @@ double benchmark_increment_note_witnesses(size_t nTxs)
 
         wtx.SetSproutNoteData(noteData);
         wallet.AddToWallet(wtx, true, NULL);
-        block2.vtx.push_back(wtx);
+        block2.vtx.push_back(MakeTransactionRef(wtx));
     }
     CBlockIndex index2(block2);
     index2.nHeight = 2;
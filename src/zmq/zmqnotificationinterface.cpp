@@ -84,6 +84,26 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    int64_t nMaxQueue = GetArg("-zmqpubqueuesize", DEFAULT_ZMQ_PUB_QUEUE_SIZE);
+    if (nMaxQueue <= 0)
+    {
+        zmqError("Invalid -zmqpubqueuesize");
+        return false;
+    }
+    int64_t nHashTxBatch = GetArg("-zmqpubhashtxbatch", DEFAULT_ZMQ_PUB_HASHTX_BATCH);
+    if (nHashTxBatch <= 0 || nHashTxBatch > std::numeric_limits<unsigned int>::max())
+    {
+        zmqError("Invalid -zmqpubhashtxbatch");
+        return false;
+    }
+
+    // Publishing happens on a thread of its own, off the notification path
+    if (!StartZMQPublisher(nMaxQueue, nHashTxBatch))
+    {
+        LogPrint("zmq", "zmq: Error: Unable to start the publisher thread\n");
+        return false;
+    }
+
     std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin();
     for (; i!=notifiers.end(); ++i)
     {
@@ -113,6 +133,7 @@ void CZMQNotificationInterface::Shutdown()
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
     if (pcontext)
     {
+        StopZMQPublisher();
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
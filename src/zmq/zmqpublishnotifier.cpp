@@ -4,9 +4,15 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "zmqpublishnotifier.h"
+#include "chainparams.h"
 #include "main.h"
 #include "util.h"
 
+#include <deque>
+#include <map>
+
+#include <boost/thread.hpp>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
@@ -54,6 +60,183 @@ static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
     return 0;
 }
 
+namespace {
+
+struct CZMQQueuedMessage
+{
+    void *psocket;
+    const char *command;
+    ZMQPayload data;
+    uint32_t nSequence;
+};
+
+/**
+ * The publisher thread and the bounded queue feeding it. ZMQ sockets must
+ * not be used from several threads at once, so all sends happen here.
+ */
+class CZMQPublisher
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<CZMQQueuedMessage> queue;
+    bool fStop;
+    boost::thread thread;
+
+    size_t nMaxQueue;
+    unsigned int nHashTxBatch;
+    size_t nPeakQueueDepth;
+    uint64_t nPublished;
+    uint64_t nDropped;
+    uint64_t nSendFailures;
+
+    bool Send(const CZMQQueuedMessage& msg)
+    {
+        unsigned char msgseq[sizeof(uint32_t)];
+        WriteLE32(&msgseq[0], msg.nSequence);
+        return zmq_send_multipart(msg.psocket, msg.command, strlen(msg.command), msg.data->data(), msg.data->size(),
+                                  msgseq, (size_t)sizeof(uint32_t), (void*)0) == 0;
+    }
+
+    /** Send vBatch, hashtx messages of one socket, as a single message, and clear it */
+    void SendBatch(std::vector<CZMQQueuedMessage>& vBatch)
+    {
+        if (vBatch.empty())
+            return;
+        CZMQQueuedMessage msg = vBatch[0];
+        if (vBatch.size() > 1) {
+            std::shared_ptr<std::vector<unsigned char> > data = std::make_shared<std::vector<unsigned char> >();
+            data->reserve(32 * vBatch.size());
+            for (size_t i = 0; i < vBatch.size(); i++)
+                data->insert(data->end(), vBatch[i].data->begin(), vBatch[i].data->end());
+            msg.data = data;
+        }
+        bool fSent = Send(msg);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fSent)
+            nPublished += vBatch.size();
+        else
+            nSendFailures += vBatch.size();
+        vBatch.clear();
+    }
+
+    void ThreadMain()
+    {
+        RenameThread("vidulum-zmqpub");
+        std::deque<CZMQQueuedMessage> vDrained;
+        std::map<void*, std::vector<CZMQQueuedMessage> > mapHashTx;
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty() && !fStop)
+                    cond.wait(lock);
+                if (queue.empty())
+                    return;
+                vDrained.swap(queue);
+            }
+
+            // Coalesce the hashtx messages of each socket. Any other message
+            // for a socket first sends its pending hashes, so that every
+            // socket still publishes in queue order.
+            BOOST_FOREACH(const CZMQQueuedMessage& msg, vDrained) {
+                std::vector<CZMQQueuedMessage>& vPending = mapHashTx[msg.psocket];
+                if (msg.command == MSG_HASHTX) {
+                    vPending.push_back(msg);
+                    if (vPending.size() >= nHashTxBatch)
+                        SendBatch(vPending);
+                } else {
+                    SendBatch(vPending);
+                    vPending.push_back(msg);
+                    SendBatch(vPending);
+                }
+            }
+            vDrained.clear();
+            for (std::map<void*, std::vector<CZMQQueuedMessage> >::iterator it = mapHashTx.begin(); it != mapHashTx.end(); ++it)
+                SendBatch(it->second);
+        }
+    }
+
+public:
+    CZMQPublisher(size_t nMaxQueueIn, unsigned int nHashTxBatchIn) :
+        fStop(false), nMaxQueue(nMaxQueueIn), nHashTxBatch(std::max(1u, nHashTxBatchIn)),
+        nPeakQueueDepth(0), nPublished(0), nDropped(0), nSendFailures(0)
+    {
+        thread = boost::thread(&CZMQPublisher::ThreadMain, this);
+    }
+
+    ~CZMQPublisher()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_one();
+        thread.join();
+    }
+
+    /** Returns false, counting a drop, if the queue is full. */
+    bool Push(const CZMQQueuedMessage& msg)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (queue.size() >= nMaxQueue) {
+                nDropped++;
+                return false;
+            }
+            queue.push_back(msg);
+            nPeakQueueDepth = std::max(nPeakQueueDepth, queue.size());
+        }
+        cond.notify_one();
+        return true;
+    }
+
+    CZMQPublisherStats GetStats()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CZMQPublisherStats stats;
+        stats.nQueueDepth = queue.size();
+        stats.nPeakQueueDepth = nPeakQueueDepth;
+        stats.nQueueCapacity = nMaxQueue;
+        stats.nHashTxBatch = nHashTxBatch;
+        stats.nPublished = nPublished;
+        stats.nDropped = nDropped;
+        stats.nSendFailures = nSendFailures;
+        return stats;
+    }
+};
+
+std::unique_ptr<CZMQPublisher> publisher;
+
+} // anon namespace
+
+bool StartZMQPublisher(size_t nMaxQueue, unsigned int nHashTxBatch)
+{
+    assert(!publisher);
+    if (nMaxQueue == 0)
+        return false;
+    try {
+        publisher.reset(new CZMQPublisher(nMaxQueue, nHashTxBatch));
+    } catch (const boost::thread_resource_error& e) {
+        LogPrint("zmq", "zmq: Error: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+void StopZMQPublisher()
+{
+    publisher.reset();
+}
+
+CZMQPublisherStats GetZMQPublisherStats()
+{
+    if (publisher)
+        return publisher->GetStats();
+    CZMQPublisherStats stats = {};
+    return stats;
+}
+
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 {
     assert(!psocket);
@@ -123,23 +306,25 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = 0;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const ZMQPayload& data)
 {
     assert(psocket);
+    assert(publisher);
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
-    if (rc == -1)
-        return false;
-
-    /* increment memory only sequence number after sending */
-    nSequence++;
+    CZMQQueuedMessage msg = {psocket, command, data, nSequence++};
+    if (!publisher->Push(msg))
+        LogPrint("zmq", "zmq: Publisher queue full, dropped %s message\n", command);
 
+    // A full queue is a slow subscriber, not a broken notifier
     return true;
 }
 
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+{
+    const unsigned char *pdata = (const unsigned char*)data;
+    return SendMessage(command, std::make_shared<const std::vector<unsigned char> >(pdata, pdata + size));
+}
+
 bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     uint256 hash = pindex->GetBlockHash();
@@ -160,31 +345,46 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
+// Notifiers are called one after another for the same block or transaction,
+// so several rawblock/rawtx notifiers (one per address) share the serialized
+// bytes of the last item. Only the notification thread gets here.
+static uint256 hashLastRawBlock;
+static ZMQPayload rawLastBlock;
+static uint256 hashLastRawTx;
+static ZMQPayload rawLastTx;
+
 bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
-    LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint("zmq", "zmq: Publish rawblock %s\n", hash.GetHex());
 
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
+    if (!rawLastBlock || hashLastRawBlock != hash) {
+        // The on-disk bytes are already the network serialization
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
         {
-            zmqError("Can't read block from disk");
-            return false;
+            LOCK(cs_main);
+            if (!ReadRawBlockFromDisk(ss, pindex, Params().MessageStart()))
+            {
+                zmqError("Can't read block from disk");
+                return false;
+            }
         }
-
-        ss << block;
+        rawLastBlock = std::make_shared<const std::vector<unsigned char> >(ss.begin(), ss.end());
+        hashLastRawBlock = hash;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, rawLastBlock);
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
-}
\ No newline at end of file
+    if (!rawLastTx || hashLastRawTx != hash) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << transaction;
+        rawLastTx = std::make_shared<const std::vector<unsigned char> >(ss.begin(), ss.end());
+        hashLastRawTx = hash;
+    }
+    return SendMessage(MSG_RAWTX, rawLastTx);
+}
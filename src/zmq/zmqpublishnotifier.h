@@ -7,21 +7,56 @@
 
 #include "zmqabstractnotifier.h"
 
+#include <memory>
+#include <vector>
+
 class CBlockIndex;
 
+static const size_t DEFAULT_ZMQ_PUB_QUEUE_SIZE = 10000;
+static const unsigned int DEFAULT_ZMQ_PUB_HASHTX_BATCH = 1;
+
+typedef std::shared_ptr<const std::vector<unsigned char> > ZMQPayload;
+
+/** Counters describing the ZMQ publisher queue, see getzmqpublisherinfo */
+struct CZMQPublisherStats
+{
+    size_t nQueueDepth;
+    size_t nPeakQueueDepth;
+    size_t nQueueCapacity;
+    unsigned int nHashTxBatch;
+    uint64_t nPublished;
+    uint64_t nDropped;
+    uint64_t nSendFailures;
+};
+
+/**
+ * Start the thread that owns all sends on the publish sockets. Notifiers only
+ * queue their messages; once nMaxQueue messages are waiting, new ones are
+ * dropped. With nHashTxBatch > 1, up to that many queued hashtx messages for
+ * the same socket are sent as one message carrying the concatenated hashes.
+ */
+bool StartZMQPublisher(size_t nMaxQueue, unsigned int nHashTxBatch);
+/** Send what is still queued and stop the publisher thread */
+void StopZMQPublisher();
+CZMQPublisherStats GetZMQPublisherStats();
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
     uint32_t nSequence; //! upcounting per message sequence number
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) { }
 
-    /* send zmq multipart message
+    /* queue zmq multipart message for the publisher thread
        parts:
           * command
           * data
           * message sequence number
+       A dropped message still uses up its sequence number, so subscribers
+       can tell that they missed something.
     */
+    bool SendMessage(const char *command, const ZMQPayload& data);
     bool SendMessage(const char *command, const void* data, size_t size);
 
     bool Initialize(void *pcontext);
@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zmqrpc.h"
+
+#include "rpc/server.h"
+#include "utilstrencodings.h"
+#include "zmqpublishnotifier.h"
+
+#include <univalue.h>
+
+using namespace std;
+
+UniValue getzmqpublisherinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getzmqpublisherinfo\n"
+            "Returns the state of the queue between ZMQ notifications and the thread publishing them.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queue_depth\": xxxxx,          (numeric) messages currently waiting to be sent\n"
+            "  \"peak_queue_depth\": xxxxx,     (numeric) highest queue depth seen\n"
+            "  \"queue_capacity\": xxxxx,       (numeric) queue size past which messages are dropped (-zmqpubqueuesize)\n"
+            "  \"hashtx_batch\": xxxxx,         (numeric) hashtx messages sent together at most (-zmqpubhashtxbatch)\n"
+            "  \"published\": xxxxx,            (numeric) messages sent\n"
+            "  \"dropped\": xxxxx,              (numeric) messages dropped because the queue was full\n"
+            "  \"send_failures\": xxxxx         (numeric) messages ZMQ failed to send\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getzmqpublisherinfo", "")
+            + HelpExampleRpc("getzmqpublisherinfo", "")
+        );
+
+    CZMQPublisherStats stats = GetZMQPublisherStats();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("queue_depth", (uint64_t)stats.nQueueDepth));
+    obj.push_back(Pair("peak_queue_depth", (uint64_t)stats.nPeakQueueDepth));
+    obj.push_back(Pair("queue_capacity", (uint64_t)stats.nQueueCapacity));
+    obj.push_back(Pair("hashtx_batch", (uint64_t)stats.nHashTxBatch));
+    obj.push_back(Pair("published", stats.nPublished));
+    obj.push_back(Pair("dropped", stats.nDropped));
+    obj.push_back(Pair("send_failures", stats.nSendFailures));
+    return obj;
+}
+
+static const CRPCCommand commands[] =
+{ //  category              name                      actor (function)         okSafeMode
+  //  --------------------- ------------------------  -----------------------  ----------
+    { "zmq",                "getzmqpublisherinfo",    &getzmqpublisherinfo,    true  },
+};
+
+void RegisterZMQRPCCommands(CRPCTable &tableRPC)
+{
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
+        tableRPC.appendCommand(commands[vcidx].name, &commands[vcidx]);
+}